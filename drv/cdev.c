@@ -20,13 +20,25 @@
 #include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/pci.h>
+#include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
 
 #include "qdma_mod.h"
+#include "qdma_ioctl.h"
 
 struct class *qdma_class;
+/* completes the asynchronous requests, flushed before a cdev goes away */
+static struct workqueue_struct *qdma_cdev_wq;
+
+/* polled completion of the asynchronous requests through ->iopoll */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,1,0)
+#define CDEV_IOPOLL
+#endif
 
 /*
  * character device file operations
@@ -36,6 +48,10 @@ static int cdev_gen_open(struct inode *inode, struct file *file)
 	struct qdma_cdev *xcdev = container_of(inode->i_cdev, struct qdma_cdev,
 						cdev);
 	file->private_data = xcdev;
+#ifdef FMODE_CAN_ODIRECT
+	/* the i/o always goes straight between the user pages and the card */
+	file->f_mode |= FMODE_CAN_ODIRECT;
+#endif
 
 	if (xcdev->fp_open_extra)
 		return xcdev->fp_open_extra(xcdev);
@@ -43,10 +59,14 @@ static int cdev_gen_open(struct inode *inode, struct file *file)
 	return 0;
 }
 
+static void cdev_user_bufs_free(struct qdma_cdev *xcdev, struct file *file);
+
 static int cdev_gen_close(struct inode *inode, struct file *file)
 {
 	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
 
+	cdev_user_bufs_free(xcdev, file);
+
 	if (xcdev->fp_close_extra)
 		return xcdev->fp_close_extra(xcdev);
 
@@ -80,11 +100,49 @@ static loff_t cdev_gen_llseek(struct file *file, loff_t off, int whence)
 	return newpos;
 }
 
+static long cdev_recv_pkts(struct qdma_cdev *xcdev, unsigned long arg);
+static long cdev_rw_segs(struct qdma_cdev *xcdev, unsigned long arg);
+static long cdev_buf_reg(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg);
+static long cdev_buf_unreg(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg);
+static long cdev_buf_io(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg);
+static long cdev_dma_pool_xfer(struct qdma_cdev *xcdev, unsigned long arg);
+static int cdev_dma_pool_mmap(struct qdma_cdev *xcdev,
+			struct vm_area_struct *vma);
+static long cdev_batch_submit(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg);
+static int cdev_batch_mmap(struct qdma_cdev *xcdev, struct file *file,
+			struct vm_area_struct *vma);
+
 static long cdev_gen_ioctl(struct file *file, unsigned int cmd,
 			unsigned long arg)
 {
 	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
 
+	switch (cmd) {
+	case QDMA_IOCTL_RX_RING_KICK:
+		return qdma_queue_rx_ring_kick(xcdev->xcb->xpdev->dev_hndl,
+						xcdev->priv_data);
+	case QDMA_IOCTL_RECV_PKTS:
+		return cdev_recv_pkts(xcdev, arg);
+	case QDMA_IOCTL_RW_SEGS:
+		return cdev_rw_segs(xcdev, arg);
+	case QDMA_IOCTL_BUF_REG:
+		return cdev_buf_reg(xcdev, file, arg);
+	case QDMA_IOCTL_BUF_UNREG:
+		return cdev_buf_unreg(xcdev, file, arg);
+	case QDMA_IOCTL_BUF_IO:
+		return cdev_buf_io(xcdev, file, arg);
+	case QDMA_IOCTL_POOL_XFER:
+		return cdev_dma_pool_xfer(xcdev, arg);
+	case QDMA_IOCTL_BATCH_SUBMIT:
+		return cdev_batch_submit(xcdev, file, arg);
+	default:
+		break;
+	}
+
 	if (xcdev->fp_ioctl_extra)
 		return xcdev->fp_ioctl_extra(xcdev, cmd, arg);
 
@@ -92,6 +150,33 @@ static long cdev_gen_ioctl(struct file *file, unsigned int cmd,
 	return -EINVAL;
 }
 
+static unsigned int cdev_gen_poll(struct file *file, poll_table *wait)
+{
+	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
+
+	return qdma_queue_poll(xcdev->xcb->xpdev->dev_hndl, xcdev->priv_data,
+				file, wait);
+}
+
+static int cdev_gen_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct qdma_cdev *xcdev = (struct qdma_cdev *)file->private_data;
+
+	if (vma->vm_pgoff == (QDMA_DMA_POOL_MMAP_OFFSET >> PAGE_SHIFT))
+		return cdev_dma_pool_mmap(xcdev, vma);
+	if (vma->vm_pgoff == (QDMA_BATCH_MMAP_OFFSET >> PAGE_SHIFT))
+		return cdev_batch_mmap(xcdev, file, vma);
+
+	if (vma->vm_pgoff != (QDMA_RX_RING_MMAP_OFFSET >> PAGE_SHIFT)) {
+		pr_info("%s mmap offset 0x%lx NOT supported.\n",
+			xcdev->name, vma->vm_pgoff << PAGE_SHIFT);
+		return -EINVAL;
+	}
+
+	return qdma_queue_rx_ring_mmap(xcdev->xcb->xpdev->dev_hndl,
+					xcdev->priv_data, vma);
+}
+
 /*
  * cdev r/w
  */
@@ -133,7 +218,6 @@ static int map_user_buf_to_sgl(struct qdma_io_cb *iocb, bool write)
 {
 	unsigned long len = iocb->len;
 	char *buf = iocb->buf;
-	struct scatterlist *sg;
 	unsigned int pages_nr = (((unsigned long)buf + len + PAGE_SIZE - 1) -
 				 ((unsigned long)buf & PAGE_MASK))
 				>> PAGE_SHIFT;
@@ -143,11 +227,6 @@ static int map_user_buf_to_sgl(struct qdma_io_cb *iocb, bool write)
 	if (pages_nr == 0)
 		return -EINVAL;
 
-	if (sg_alloc_table(iocb->sgt, pages_nr, GFP_KERNEL)) {
-		pr_info("sgl OOM.\n");
-		return -ENOMEM;
-	}
-
 	iocb->pages = kcalloc(pages_nr, sizeof(struct page *), GFP_KERNEL);
 	if (!iocb->pages) {
 		pr_info("pages OOM.\n");
@@ -167,8 +246,8 @@ static int map_user_buf_to_sgl(struct qdma_io_cb *iocb, bool write)
 	if (rv != pages_nr) {
 		pr_info("unable to pin down all %u user pages, %d.\n",
 			pages_nr, rv);
-		rv = -EFAULT;
 		iocb->pages_nr = rv;
+		rv = -EFAULT;
 		goto err_out;
 	}
 
@@ -182,24 +261,25 @@ static int map_user_buf_to_sgl(struct qdma_io_cb *iocb, bool write)
 		}
 	}
 
-	sg = iocb->sgt->sgl;
-	for (i = 0; i < pages_nr; i++, sg = sg_next(sg)) {
-		unsigned int offset = offset_in_page(buf);
-		unsigned int nbytes = min_t(unsigned int, PAGE_SIZE - offset,
-						len);
-
+	for (i = 0; i < pages_nr; i++)
 		flush_dcache_page(iocb->pages[i]);
-		sg_set_page(sg, iocb->pages[i], nbytes, offset);
 
-		buf += nbytes;
-		len -= nbytes;
+	iocb->pages_nr = pages_nr;
+
+	/* physically contiguous pages (e.g., huge pages) share one entry */
+	if (sg_alloc_table_from_pages(iocb->sgt, iocb->pages, pages_nr,
+				offset_in_page(buf), len, GFP_KERNEL)) {
+		pr_info("sgl OOM, %u pages.\n", pages_nr);
+		rv = -ENOMEM;
+		goto err_out;
 	}
 
-	iocb->pages_nr = pages_nr;
 	return 0;
 
 err_out:
 	unmap_user_buf(iocb, write);
+	kfree(iocb->pages);
+	iocb->pages = NULL;
 
 	return rv;
 }
@@ -251,6 +331,1169 @@ static ssize_t cdev_gen_read_write(struct file *file, char __user *buf,
 	return res;
 }
 
+/* max. # of packets per QDMA_IOCTL_RECV_PKTS */
+#define RECV_PKTS_MAX	1024
+
+static long cdev_recv_pkts(struct qdma_cdev *xcdev, unsigned long arg)
+{
+	struct qdma_ioc_recv_pkts __user *uarg = (void __user *)arg;
+	struct qdma_ioc_recv_pkts ioc;
+	struct qdma_pkt_req preq;
+	struct qdma_io_cb iocb;
+	size_t len;
+	long rv;
+
+	if (copy_from_user(&ioc, uarg, sizeof(ioc)))
+		return -EFAULT;
+
+	if (!ioc.pkt_max || !ioc.buf_len)
+		return -EINVAL;
+	/* same cap as read(), the rest of the buffer is left untouched */
+	len = min_t(u64, ioc.buf_len, MAX_RW_COUNT);
+	if (ioc.pkt_max > RECV_PKTS_MAX)
+		ioc.pkt_max = RECV_PKTS_MAX;
+	if (ioc.pkt_min > ioc.pkt_max)
+		ioc.pkt_min = ioc.pkt_max;
+
+	memset(&preq, 0, sizeof(struct qdma_pkt_req));
+	preq.pkts = kcalloc(ioc.pkt_max, sizeof(struct qdma_pkt_desc),
+				GFP_KERNEL);
+	if (!preq.pkts)
+		return -ENOMEM;
+
+	memset(&iocb, 0, sizeof(struct qdma_io_cb));
+	iocb.buf = (void __user *)(unsigned long)ioc.buf;
+	iocb.len = len;
+	iocb.sgt = &preq.sgt;
+	rv = map_user_buf_to_sgl(&iocb, false);
+	if (rv < 0)
+		goto free_pkts;
+
+	preq.count = len;
+	preq.pkt_max = ioc.pkt_max;
+	preq.pkt_min = ioc.pkt_min;
+	preq.timeout_ms = ioc.timeout_ms;
+
+	rv = qdma_queue_recv_pkts(xcdev->xcb->xpdev->dev_hndl,
+				xcdev->priv_data, &preq);
+
+	unmap_user_buf(&iocb, false);
+	iocb_release(&iocb);
+	if (rv < 0)
+		goto free_pkts;
+
+	ioc.pkt_cnt = preq.pkt_cnt;
+	ioc.bytes = preq.bytes;
+	if (copy_to_user((void __user *)(unsigned long)ioc.pkts, preq.pkts,
+			preq.pkt_cnt * sizeof(struct qdma_pkt_desc)) ||
+	    copy_to_user(uarg, &ioc, sizeof(ioc)))
+		rv = -EFAULT;
+	else
+		rv = 0;
+
+free_pkts:
+	kfree(preq.pkts);
+	return rv;
+}
+
+static long cdev_rw_segs(struct qdma_cdev *xcdev, unsigned long arg)
+{
+	struct qdma_ioc_rw_segs ioc;
+	struct qdma_queue_conf *qconf;
+	struct qdma_ioc_seg *segs;
+	struct qdma_io_cb *iocbs = NULL;
+	struct sg_table *sgts = NULL;
+	struct qdma_io_cb iocb;
+	struct qdma_sg_req *req = &iocb.req;
+	struct scatterlist *sg;
+	unsigned int nents = 0;
+	int mapped = 0;
+	bool write;
+	u64 count = 0;
+	long rv;
+	int i;
+
+	if (copy_from_user(&ioc, (void __user *)arg, sizeof(ioc)))
+		return -EFAULT;
+	if (!ioc.seg_nr || ioc.seg_nr > QDMA_RW_SEGS_MAX || !xcdev->fp_rw)
+		return -EINVAL;
+
+	qconf = qdma_queue_get_config(xcdev->xcb->xpdev->dev_hndl,
+				xcdev->priv_data, NULL, 0);
+	if (!qconf)
+		return -EINVAL;
+	if (qconf->st) {
+		pr_info("%s, NOT a mm queue.\n", xcdev->name);
+		return -EINVAL;
+	}
+	write = !qconf->c2h;
+
+	segs = kcalloc(ioc.seg_nr, sizeof(struct qdma_ioc_seg), GFP_KERNEL);
+	memset(&iocb, 0, sizeof(struct qdma_io_cb));
+	req->ep_segs = kcalloc(ioc.seg_nr, sizeof(struct qdma_ep_seg),
+				GFP_KERNEL);
+	iocbs = kcalloc(ioc.seg_nr, sizeof(struct qdma_io_cb), GFP_KERNEL);
+	sgts = kcalloc(ioc.seg_nr, sizeof(struct sg_table), GFP_KERNEL);
+	if (!segs || !req->ep_segs || !iocbs || !sgts) {
+		rv = -ENOMEM;
+		goto free_segs;
+	}
+	if (copy_from_user(segs, (void __user *)(unsigned long)ioc.segs,
+			ioc.seg_nr * sizeof(struct qdma_ioc_seg))) {
+		rv = -EFAULT;
+		goto free_segs;
+	}
+
+	for (i = 0; i < ioc.seg_nr; i++) {
+		if (!segs[i].len || segs[i].len > UINT_MAX) {
+			rv = -EINVAL;
+			goto free_segs;
+		}
+		count += segs[i].len;
+		req->ep_segs[i].ep_addr = segs[i].ep_addr;
+		req->ep_segs[i].len = segs[i].len;
+	}
+
+	/* pin each host buffer on its own, contiguous pages merged */
+	for (i = 0; i < ioc.seg_nr; i++) {
+		iocbs[i].buf = (void __user *)(unsigned long)segs[i].buf;
+		iocbs[i].len = segs[i].len;
+		iocbs[i].sgt = &sgts[i];
+		rv = map_user_buf_to_sgl(&iocbs[i], write);
+		if (rv < 0) {
+			pr_info("%s, seg %d, unable to map the buffer, %ld.\n",
+				xcdev->name, i, rv);
+			goto unmap;
+		}
+		mapped++;
+		nents += sgts[i].nents;
+	}
+
+	/* then line their entries up in the one table of the request */
+	if (sg_alloc_table(&req->sgt, nents, GFP_KERNEL)) {
+		rv = -ENOMEM;
+		goto unmap;
+	}
+	sg = req->sgt.sgl;
+	for (i = 0; i < ioc.seg_nr; i++) {
+		struct scatterlist *s;
+		int j;
+
+		for_each_sg(sgts[i].sgl, s, sgts[i].nents, j) {
+			sg_set_page(sg, sg_page(s), s->length, s->offset);
+			sg = sg_next(sg);
+		}
+	}
+
+	req->write = write;
+	req->dma_mapped = false;
+	req->count = count;
+	req->ep_seg_nr = ioc.seg_nr;
+	req->timeout_ms = 10 * 1000;	/* 10 seconds */
+	req->fp_done = NULL;		/* blocking */
+
+	rv = xcdev->fp_rw(xcdev->xcb->xpdev->dev_hndl, xcdev->priv_data, req);
+
+	sg_free_table(&req->sgt);
+unmap:
+	for (i = 0; i < mapped; i++) {
+		unmap_user_buf(&iocbs[i], write);
+		iocb_release(&iocbs[i]);
+	}
+free_segs:
+	kfree(sgts);
+	kfree(iocbs);
+	kfree(req->ep_segs);
+	kfree(segs);
+	return rv;
+}
+
+/*
+ * registered user buffers: pinned down and dma mapped once, then used for
+ * any number of transfers
+ */
+/* max. # of buffers registered per queue */
+#define USER_BUF_MAX	64
+
+struct cdev_user_buf {
+	struct list_head list;
+	struct file *file;		/* registered through */
+	u32 id;
+	int busy;			/* # of transfers using it */
+	u64 len;
+	unsigned int pg_off;		/* of the start in the 1st page */
+	unsigned int pages_nr;
+	struct page **pages;
+	struct sg_table sgt;		/* contiguous pages merged */
+	bool mapped;			/* sgt dma mapped */
+};
+
+static void user_buf_free(struct qdma_cdev *xcdev, struct cdev_user_buf *ubuf)
+{
+	int i;
+
+	if (ubuf->mapped)
+		pci_unmap_sg(xcdev->xcb->xpdev->pdev, ubuf->sgt.sgl,
+			ubuf->sgt.orig_nents, PCI_DMA_BIDIRECTIONAL);
+	if (ubuf->sgt.sgl)
+		sg_free_table(&ubuf->sgt);
+
+	for (i = 0; i < ubuf->pages_nr; i++) {
+		set_page_dirty_lock(ubuf->pages[i]);
+		put_page(ubuf->pages[i]);
+	}
+	kfree(ubuf->pages);
+	kfree(ubuf);
+}
+
+/* file NULL: all of them */
+static void cdev_user_bufs_free(struct qdma_cdev *xcdev, struct file *file)
+{
+	struct cdev_user_buf *ubuf, *tmp;
+	LIST_HEAD(free_list);
+
+	spin_lock(&xcdev->lock);
+	list_for_each_entry_safe(ubuf, tmp, &xcdev->buf_list, list) {
+		if (file && ubuf->file != file)
+			continue;
+		list_move_tail(&ubuf->list, &free_list);
+		xcdev->buf_cnt--;
+	}
+	spin_unlock(&xcdev->lock);
+
+	list_for_each_entry_safe(ubuf, tmp, &free_list, list)
+		user_buf_free(xcdev, ubuf);
+}
+
+static struct cdev_user_buf *user_buf_get(struct qdma_cdev *xcdev,
+					struct file *file, u32 id)
+{
+	struct cdev_user_buf *ubuf;
+
+	spin_lock(&xcdev->lock);
+	list_for_each_entry(ubuf, &xcdev->buf_list, list) {
+		if (ubuf->id == id && ubuf->file == file) {
+			ubuf->busy++;
+			spin_unlock(&xcdev->lock);
+			return ubuf;
+		}
+	}
+	spin_unlock(&xcdev->lock);
+
+	return NULL;
+}
+
+static void user_buf_put(struct qdma_cdev *xcdev, struct cdev_user_buf *ubuf)
+{
+	spin_lock(&xcdev->lock);
+	ubuf->busy--;
+	spin_unlock(&xcdev->lock);
+}
+
+/* the dma view of [off, off + len) of a registered buffer */
+static int user_buf_sgt_dma(struct cdev_user_buf *ubuf, struct sg_table *sgt,
+			u64 off, u64 len)
+{
+	struct scatterlist *sg, *to, *first = NULL;
+	unsigned int nents = 0;
+	u64 left = len;
+	int i;
+
+	for_each_sg(ubuf->sgt.sgl, sg, ubuf->sgt.nents, i) {
+		u64 dlen = sg_dma_len(sg);
+
+		if (!first) {
+			if (off >= dlen) {
+				off -= dlen;
+				continue;
+			}
+			first = sg;
+			dlen -= off;
+		}
+		nents++;
+		if (left <= dlen)
+			break;
+		left -= dlen;
+	}
+	if (!first)
+		return -EINVAL;
+
+	if (sg_alloc_table(sgt, nents, GFP_KERNEL))
+		return -ENOMEM;
+
+	left = len;
+	sg = first;
+	for_each_sg(sgt->sgl, to, nents, i) {
+		unsigned int dlen = min_t(u64, sg_dma_len(sg) - off, left);
+
+		sg_dma_address(to) = sg_dma_address(sg) + off;
+		sg_dma_len(to) = dlen;
+		to->length = dlen;
+		left -= dlen;
+		off = 0;
+		sg = sg_next(sg);
+	}
+
+	return 0;
+}
+
+/* the cpu view of [off, off + len) of a registered buffer, for st c2h */
+static int user_buf_sgt_cpu(struct cdev_user_buf *ubuf, struct sg_table *sgt,
+			u64 off, u64 len)
+{
+	u64 start = ubuf->pg_off + off;
+	unsigned int pg_off = offset_in_page(start);
+
+	return sg_alloc_table_from_pages(sgt, ubuf->pages + (start >> PAGE_SHIFT),
+				(pg_off + len + PAGE_SIZE - 1) >> PAGE_SHIFT,
+				pg_off, len, GFP_KERNEL);
+}
+
+/* the mapping outlives the transfers, hand the data over explicitly */
+static void user_buf_sync(struct qdma_cdev *xcdev, struct sg_table *sgt,
+			bool for_device)
+{
+	struct device *dev = &xcdev->xcb->xpdev->pdev->dev;
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(sgt->sgl, sg, sgt->nents, i) {
+		if (for_device)
+			dma_sync_single_for_device(dev, sg_dma_address(sg),
+					sg_dma_len(sg), DMA_BIDIRECTIONAL);
+		else
+			dma_sync_single_for_cpu(dev, sg_dma_address(sg),
+					sg_dma_len(sg), DMA_BIDIRECTIONAL);
+	}
+}
+
+static long cdev_buf_unreg_id(struct qdma_cdev *xcdev, struct file *file,
+			u32 id)
+{
+	struct cdev_user_buf *ubuf;
+
+	spin_lock(&xcdev->lock);
+	list_for_each_entry(ubuf, &xcdev->buf_list, list) {
+		if (ubuf->id != id || ubuf->file != file)
+			continue;
+		if (ubuf->busy) {
+			spin_unlock(&xcdev->lock);
+			return -EBUSY;
+		}
+		list_del(&ubuf->list);
+		xcdev->buf_cnt--;
+		spin_unlock(&xcdev->lock);
+
+		user_buf_free(xcdev, ubuf);
+		return 0;
+	}
+	spin_unlock(&xcdev->lock);
+
+	return -EINVAL;
+}
+
+static long cdev_buf_unreg(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg)
+{
+	u32 id;
+
+	if (get_user(id, (u32 __user *)arg))
+		return -EFAULT;
+
+	return cdev_buf_unreg_id(xcdev, file, id);
+}
+
+static long cdev_buf_reg(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg)
+{
+	struct qdma_ioc_buf_reg __user *uarg = (void __user *)arg;
+	struct qdma_ioc_buf_reg ioc;
+	struct cdev_user_buf *ubuf;
+	unsigned long pages_nr;
+	long rv;
+
+	if (copy_from_user(&ioc, uarg, sizeof(ioc)))
+		return -EFAULT;
+	if (!ioc.len)
+		return -EINVAL;
+
+	pages_nr = (((unsigned long)ioc.addr + ioc.len + PAGE_SIZE - 1) -
+			((unsigned long)ioc.addr & PAGE_MASK)) >> PAGE_SHIFT;
+	if (pages_nr > INT_MAX)
+		return -EINVAL;
+
+	ubuf = kzalloc(sizeof(struct cdev_user_buf), GFP_KERNEL);
+	if (!ubuf)
+		return -ENOMEM;
+	ubuf->file = file;
+	ubuf->len = ioc.len;
+	ubuf->pg_off = offset_in_page(ioc.addr);
+
+	ubuf->pages = kcalloc(pages_nr, sizeof(struct page *), GFP_KERNEL);
+	if (!ubuf->pages) {
+		rv = -ENOMEM;
+		goto err_out;
+	}
+
+	rv = get_user_pages_fast((unsigned long)ioc.addr, pages_nr,
+				1/* write */, ubuf->pages);
+	if (rv > 0)
+		ubuf->pages_nr = rv;
+	if (rv != pages_nr) {
+		pr_info("%s, unable to pin down %lu user pages, %ld.\n",
+			xcdev->name, pages_nr, rv);
+		rv = -EFAULT;
+		goto err_out;
+	}
+
+	rv = sg_alloc_table_from_pages(&ubuf->sgt, ubuf->pages, pages_nr,
+				ubuf->pg_off, ioc.len, GFP_KERNEL);
+	if (rv < 0) {
+		pr_info("%s, sgl OOM, %lu pages.\n", xcdev->name, pages_nr);
+		goto err_out;
+	}
+
+	rv = pci_map_sg(xcdev->xcb->xpdev->pdev, ubuf->sgt.sgl,
+			ubuf->sgt.orig_nents, PCI_DMA_BIDIRECTIONAL);
+	if (!rv) {
+		pr_info("%s, map sgl failed, %u.\n",
+			xcdev->name, ubuf->sgt.orig_nents);
+		rv = -EIO;
+		goto err_out;
+	}
+	ubuf->sgt.nents = rv;
+	ubuf->mapped = true;
+
+	spin_lock(&xcdev->lock);
+	if (xcdev->buf_cnt >= USER_BUF_MAX) {
+		spin_unlock(&xcdev->lock);
+		rv = -ENOSPC;
+		goto err_out;
+	}
+	ubuf->id = xcdev->buf_id_next++;
+	list_add_tail(&ubuf->list, &xcdev->buf_list);
+	xcdev->buf_cnt++;
+	spin_unlock(&xcdev->lock);
+
+	pr_debug("%s, buf %u, 0x%llx,%llu, %u pages, %u/%u sg.\n",
+		xcdev->name, ubuf->id, ioc.addr, ioc.len, ubuf->pages_nr,
+		ubuf->sgt.nents, ubuf->sgt.orig_nents);
+
+	ioc.id = ubuf->id;
+	if (copy_to_user(uarg, &ioc, sizeof(ioc))) {
+		cdev_buf_unreg_id(xcdev, file, ioc.id);
+		return -EFAULT;
+	}
+	return 0;
+
+err_out:
+	user_buf_free(xcdev, ubuf);
+	return rv;
+}
+
+static long cdev_buf_io(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg)
+{
+	struct qdma_ioc_buf_io __user *uarg = (void __user *)arg;
+	struct qdma_ioc_buf_io ioc;
+	struct qdma_queue_conf *qconf;
+	struct cdev_user_buf *ubuf;
+	struct qdma_sg_req req;
+	bool st_c2h;
+	ssize_t res;
+	long rv;
+
+	if (copy_from_user(&ioc, uarg, sizeof(ioc)))
+		return -EFAULT;
+	if (!ioc.len || !xcdev->fp_rw)
+		return -EINVAL;
+
+	qconf = qdma_queue_get_config(xcdev->xcb->xpdev->dev_hndl,
+				xcdev->priv_data, NULL, 0);
+	if (!qconf)
+		return -EINVAL;
+	st_c2h = qconf->st && qconf->c2h;
+
+	ubuf = user_buf_get(xcdev, file, ioc.id);
+	if (!ubuf) {
+		pr_info("%s, buf %u NOT registered.\n", xcdev->name, ioc.id);
+		return -EINVAL;
+	}
+	if (ioc.offset >= ubuf->len || ioc.len > ubuf->len - ioc.offset) {
+		pr_info("%s, buf %u, %llu,%llu out of range %llu.\n",
+			xcdev->name, ioc.id, ioc.offset, ioc.len, ubuf->len);
+		rv = -EINVAL;
+		goto put_buf;
+	}
+
+	memset(&req, 0, sizeof(struct qdma_sg_req));
+	if (st_c2h)
+		rv = user_buf_sgt_cpu(ubuf, &req.sgt, ioc.offset, ioc.len);
+	else
+		rv = user_buf_sgt_dma(ubuf, &req.sgt, ioc.offset, ioc.len);
+	if (rv < 0)
+		goto put_buf;
+
+	req.write = !qconf->c2h;
+	req.dma_mapped = true;
+	req.ep_addr = ioc.ep_addr;
+	req.count = ioc.len;
+	req.timeout_ms = 10 * 1000;	/* 10 seconds */
+	req.fp_done = NULL;		/* blocking */
+
+	if (!st_c2h)
+		user_buf_sync(xcdev, &req.sgt, true);
+	res = xcdev->fp_rw(xcdev->xcb->xpdev->dev_hndl, xcdev->priv_data,
+				&req);
+	if (!st_c2h && qconf->c2h)
+		user_buf_sync(xcdev, &req.sgt, false);
+	sg_free_table(&req.sgt);
+
+	if (res < 0) {
+		rv = res;
+		goto put_buf;
+	}
+
+	ioc.bytes = res;
+	rv = put_user(ioc.bytes, &uarg->bytes) ? -EFAULT : 0;
+
+put_buf:
+	user_buf_put(xcdev, ubuf);
+	return rv;
+}
+
+/*
+ * dma pool: driver allocated and dma mapped memory the application builds
+ * its data in. A transfer that failed may have left the engine working on
+ * the pool, it keeps its reference parked until the queue is gone.
+ */
+struct cdev_dma_pool {
+	struct qdma_cdev *xcdev;
+	int users;			/* mappings + transfers, under lock */
+	bool parked;			/* on xcdev->dma_pool_parked */
+	struct list_head list;
+	bool c2h;
+	size_t len;
+	void *vaddr;
+	dma_addr_t dma_addr;
+};
+
+static void dma_pool_put(struct cdev_dma_pool *pool)
+{
+	struct qdma_cdev *xcdev = pool->xcdev;
+	bool last;
+
+	spin_lock(&xcdev->lock);
+	last = !--pool->users;
+	/* only the parked reference left: no longer mapped */
+	if (xcdev->dma_pool == pool && pool->users == pool->parked)
+		xcdev->dma_pool = NULL;
+	spin_unlock(&xcdev->lock);
+
+	if (!last)
+		return;
+
+	pr_debug("%s, dma pool %zu freed.\n", xcdev->name, pool->len);
+	dma_free_coherent(&xcdev->xcb->xpdev->pdev->dev, pool->len,
+			pool->vaddr, pool->dma_addr);
+	kfree(pool);
+}
+
+static struct cdev_dma_pool *dma_pool_get(struct qdma_cdev *xcdev)
+{
+	struct cdev_dma_pool *pool;
+
+	spin_lock(&xcdev->lock);
+	pool = xcdev->dma_pool;
+	if (pool)
+		pool->users++;
+	spin_unlock(&xcdev->lock);
+
+	return pool;
+}
+
+/* a failed transfer's reference, held until the queue is destroyed */
+static void dma_pool_park(struct cdev_dma_pool *pool)
+{
+	struct qdma_cdev *xcdev = pool->xcdev;
+	bool parked;
+
+	spin_lock(&xcdev->lock);
+	parked = pool->parked;
+	if (!parked) {
+		pool->parked = true;
+		list_add_tail(&pool->list, &xcdev->dma_pool_parked);
+	}
+	spin_unlock(&xcdev->lock);
+
+	if (parked)
+		dma_pool_put(pool);
+}
+
+static void dma_pools_unpark(struct qdma_cdev *xcdev)
+{
+	struct cdev_dma_pool *pool, *tmp;
+	LIST_HEAD(parked);
+
+	spin_lock(&xcdev->lock);
+	list_splice_init(&xcdev->dma_pool_parked, &parked);
+	spin_unlock(&xcdev->lock);
+
+	list_for_each_entry_safe(pool, tmp, &parked, list) {
+		list_del(&pool->list);
+		pool->parked = false;
+		dma_pool_put(pool);
+	}
+}
+
+static void dma_pool_vm_open(struct vm_area_struct *vma)
+{
+	struct cdev_dma_pool *pool = vma->vm_private_data;
+
+	spin_lock(&pool->xcdev->lock);
+	pool->users++;
+	spin_unlock(&pool->xcdev->lock);
+}
+
+static void dma_pool_vm_close(struct vm_area_struct *vma)
+{
+	dma_pool_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct dma_pool_vm_ops = {
+	.open = dma_pool_vm_open,
+	.close = dma_pool_vm_close,
+};
+
+static int cdev_dma_pool_mmap(struct qdma_cdev *xcdev,
+			struct vm_area_struct *vma)
+{
+	struct device *dev = &xcdev->xcb->xpdev->pdev->dev;
+	size_t len = vma->vm_end - vma->vm_start;
+	struct qdma_queue_conf *qconf;
+	struct cdev_dma_pool *pool;
+	int rv;
+
+	qconf = qdma_queue_get_config(xcdev->xcb->xpdev->dev_hndl,
+				xcdev->priv_data, NULL, 0);
+	if (!qconf)
+		return -EINVAL;
+	if (qconf->st && qconf->c2h) {
+		pr_info("%s, st c2h, NO dma pool.\n", xcdev->name);
+		return -EINVAL;
+	}
+	if (len > QDMA_DMA_POOL_LEN_MAX) {
+		pr_info("%s, dma pool %zu > %u.\n",
+			xcdev->name, len, QDMA_DMA_POOL_LEN_MAX);
+		return -EINVAL;
+	}
+
+	pool = kzalloc_node(sizeof(struct cdev_dma_pool), GFP_KERNEL,
+				dev_to_node(dev));
+	if (!pool)
+		return -ENOMEM;
+	pool->xcdev = xcdev;
+	pool->users = 1;
+	pool->c2h = qconf->c2h;
+	pool->len = len;
+
+	/* allocated from the device's numa node */
+	pool->vaddr = dma_alloc_coherent(dev, len, &pool->dma_addr,
+					GFP_KERNEL);
+	if (!pool->vaddr) {
+		pr_info("%s, dma pool %zu OOM.\n", xcdev->name, len);
+		kfree(pool);
+		return -ENOMEM;
+	}
+
+	spin_lock(&xcdev->lock);
+	if (xcdev->dma_pool) {
+		spin_unlock(&xcdev->lock);
+		pr_info("%s, dma pool already mapped.\n", xcdev->name);
+		dma_free_coherent(dev, len, pool->vaddr, pool->dma_addr);
+		kfree(pool);
+		return -EBUSY;
+	}
+	xcdev->dma_pool = pool;
+	spin_unlock(&xcdev->lock);
+
+	/* the offset only selects the pool */
+	vma->vm_pgoff = 0;
+	rv = dma_mmap_coherent(dev, vma, pool->vaddr, pool->dma_addr, len);
+	if (rv < 0) {
+		pr_info("%s, dma pool mmap failed %d.\n", xcdev->name, rv);
+		dma_pool_put(pool);
+		return rv;
+	}
+	vma->vm_private_data = pool;
+	vma->vm_ops = &dma_pool_vm_ops;
+
+	return 0;
+}
+
+static long cdev_dma_pool_xfer(struct qdma_cdev *xcdev, unsigned long arg)
+{
+	struct qdma_ioc_pool_xfer ioc;
+	struct cdev_dma_pool *pool;
+	struct qdma_sg_req req;
+	struct scatterlist sg;
+	ssize_t res;
+
+	if (copy_from_user(&ioc, (void __user *)arg, sizeof(ioc)))
+		return -EFAULT;
+	if (!ioc.len || ioc.flags || !xcdev->fp_rw)
+		return -EINVAL;
+
+	pool = dma_pool_get(xcdev);
+	if (!pool) {
+		pr_info("%s, NO dma pool.\n", xcdev->name);
+		return -EINVAL;
+	}
+
+	if (ioc.offset >= pool->len || ioc.len > pool->len - ioc.offset) {
+		pr_info("%s, %llu,%llu out of dma pool %zu.\n",
+			xcdev->name, ioc.offset, ioc.len, pool->len);
+		res = -EINVAL;
+		goto put_pool;
+	}
+
+	/* already mapped and contiguous, one entry, nothing allocated */
+	sg_init_table(&sg, 1);
+	sg_dma_address(&sg) = pool->dma_addr + ioc.offset;
+	sg_dma_len(&sg) = ioc.len;
+	sg.length = ioc.len;
+
+	memset(&req, 0, sizeof(struct qdma_sg_req));
+	req.sgt.sgl = &sg;
+	req.sgt.nents = 1;
+	req.sgt.orig_nents = 1;
+	req.write = !pool->c2h;
+	req.dma_mapped = true;
+	req.ep_addr = ioc.ep_addr;
+	req.count = ioc.len;
+	req.timeout_ms = 10 * 1000;	/* 10 seconds */
+	req.fp_done = NULL;		/* blocking */
+
+	res = xcdev->fp_rw(xcdev->xcb->xpdev->dev_hndl, xcdev->priv_data,
+				&req);
+	if (res < 0) {
+		/*
+		 * a timed out transfer is taken off the queue, but what was
+		 * posted of it may still be running
+		 */
+		dma_pool_park(pool);
+		return res;
+	}
+
+put_pool:
+	dma_pool_put(pool);
+	return res;
+}
+
+/*
+ * batch submission: transfers queued on a shared submission ring are
+ * handed to the queue non-blocking, each one posted to the shared
+ * completion ring once done
+ */
+struct batch_req {
+	struct list_head list;		/* on the free list */
+	struct cdev_batch *batch;
+	u64 user_data;
+	struct cdev_user_buf *ubuf;	/* registered buffer, if not the pool */
+	struct scatterlist sg;		/* the pool */
+	struct qdma_sg_req req;
+};
+
+struct cdev_batch {
+	struct qdma_cdev *xcdev;
+	struct file *file;		/* mapped through */
+	struct cdev_dma_pool *pool;	/* held once used */
+	bool c2h;
+
+	struct qdma_batch_hdr *hdr;
+	struct qdma_batch_sqe *sqe;
+	struct qdma_batch_cqe *cqe;
+	unsigned int ring_sz;
+	unsigned long len;
+
+	/* serializes the submitters */
+	struct mutex submit_lock;
+	u32 sq_head;
+
+	/* protects the rest */
+	spinlock_t lock;
+	int users;			/* mappings + transfers in flight */
+	unsigned int inflight;
+	u32 cq_tail;
+	struct list_head free_list;
+	struct batch_req *reqs;
+
+	wait_queue_head_t wq;
+	struct work_struct free_work;
+};
+
+static void batch_free(struct cdev_batch *batch)
+{
+	struct qdma_cdev *xcdev = batch->xcdev;
+
+	spin_lock(&xcdev->lock);
+	if (xcdev->batch == batch)
+		xcdev->batch = NULL;
+	spin_unlock(&xcdev->lock);
+
+	if (batch->pool)
+		dma_pool_put(batch->pool);
+	if (batch->file)
+		fput(batch->file);
+	vfree(batch->hdr);
+	kfree(batch->reqs);
+	kfree(batch);
+}
+
+static void batch_free_work(struct work_struct *work)
+{
+	batch_free(container_of(work, struct cdev_batch, free_work));
+}
+
+/* the last reference may go away with a completion, free it from a work */
+static void batch_put(struct cdev_batch *batch)
+{
+	bool last;
+
+	spin_lock(&batch->lock);
+	last = !--batch->users;
+	spin_unlock(&batch->lock);
+
+	if (last)
+		schedule_work(&batch->free_work);
+}
+
+static struct cdev_batch *batch_get(struct qdma_cdev *xcdev)
+{
+	struct cdev_batch *batch;
+
+	spin_lock(&xcdev->lock);
+	batch = xcdev->batch;
+	if (batch) {
+		spin_lock(&batch->lock);
+		/* on its way out */
+		if (batch->users)
+			batch->users++;
+		else
+			batch = NULL;
+		spin_unlock(&batch->lock);
+	}
+	spin_unlock(&xcdev->lock);
+
+	return batch;
+}
+
+/* # of cqes not handled yet, calling routine holds the lock */
+static inline unsigned int batch_cq_pending(struct cdev_batch *batch)
+{
+	unsigned int pending = batch->cq_tail - READ_ONCE(batch->hdr->cq_head);
+
+	/* a bogus cq_head only stalls the ring */
+	return min(pending, batch->ring_sz);
+}
+
+/* calling routine holds the lock */
+static void batch_post(struct cdev_batch *batch, u64 user_data, long res)
+{
+	struct qdma_batch_cqe *cqe = batch->cqe +
+				(batch->cq_tail & (batch->ring_sz - 1));
+
+	cqe->user_data = user_data;
+	cqe->res = res;
+	cqe->rsvd = 0;
+	batch->cq_tail++;
+	smp_wmb();
+	WRITE_ONCE(batch->hdr->cq_tail, batch->cq_tail);
+}
+
+static void batch_req_release(struct batch_req *breq)
+{
+	struct cdev_batch *batch = breq->batch;
+
+	if (!breq->ubuf)
+		return;
+
+	if (breq->req.sgt.sgl) {
+		if (batch->c2h)
+			user_buf_sync(batch->xcdev, &breq->req.sgt, false);
+		sg_free_table(&breq->req.sgt);
+	}
+	user_buf_put(batch->xcdev, breq->ubuf);
+	breq->ubuf = NULL;
+}
+
+/* fp_done, called with the queue lock held */
+static int batch_req_done(struct qdma_sg_req *req, u64 bytes_done, int err)
+{
+	struct batch_req *breq = (struct batch_req *)req->priv_data;
+	struct cdev_batch *batch = breq->batch;
+
+	batch_req_release(breq);
+
+	spin_lock(&batch->lock);
+	batch_post(batch, breq->user_data, err ? err : bytes_done);
+	list_add(&breq->list, &batch->free_list);
+	batch->inflight--;
+	spin_unlock(&batch->lock);
+
+	wake_up_interruptible(&batch->wq);
+	batch_put(batch);
+	return 0;
+}
+
+static int batch_req_prep(struct cdev_batch *batch, struct batch_req *breq,
+			const struct qdma_batch_sqe *sqe)
+{
+	struct qdma_cdev *xcdev = batch->xcdev;
+	struct qdma_sg_req *req = &breq->req;
+	u64 buf_len;
+	int rv;
+
+	memset(req, 0, sizeof(struct qdma_sg_req));
+	breq->ubuf = NULL;
+
+	if (!sqe->len || (sqe->flags & ~QDMA_BATCH_F_POOL))
+		return -EINVAL;
+
+	if (sqe->flags & QDMA_BATCH_F_POOL) {
+		if (!batch->pool)
+			batch->pool = dma_pool_get(xcdev);
+		if (!batch->pool)
+			return -EINVAL;
+		buf_len = batch->pool->len;
+	} else {
+		breq->ubuf = user_buf_get(xcdev, batch->file, sqe->buf_id);
+		if (!breq->ubuf)
+			return -EINVAL;
+		buf_len = breq->ubuf->len;
+	}
+	if (sqe->offset >= buf_len || sqe->len > buf_len - sqe->offset)
+		return -EINVAL;
+
+	if (breq->ubuf) {
+		rv = user_buf_sgt_dma(breq->ubuf, &req->sgt, sqe->offset,
+					sqe->len);
+		if (rv < 0)
+			return rv;
+		user_buf_sync(xcdev, &req->sgt, true);
+	} else {
+		sg_init_table(&breq->sg, 1);
+		sg_dma_address(&breq->sg) = batch->pool->dma_addr + sqe->offset;
+		sg_dma_len(&breq->sg) = sqe->len;
+		breq->sg.length = sqe->len;
+		req->sgt.sgl = &breq->sg;
+		req->sgt.nents = 1;
+		req->sgt.orig_nents = 1;
+	}
+
+	req->write = !batch->c2h;
+	req->dma_mapped = true;
+	req->ep_addr = sqe->ep_addr;
+	req->count = sqe->len;
+	req->priv_data = (unsigned long)breq;
+	req->fp_done = batch_req_done;
+
+	return 0;
+}
+
+static long cdev_batch_submit(struct qdma_cdev *xcdev, struct file *file,
+			unsigned long arg)
+{
+	struct qdma_ioc_batch_submit ioc;
+	struct cdev_batch *batch;
+	unsigned int submitted = 0;
+	u32 sq_tail;
+	long rv;
+
+	if (copy_from_user(&ioc, (void __user *)arg, sizeof(ioc)))
+		return -EFAULT;
+	if (!xcdev->fp_rw)
+		return -EINVAL;
+
+	batch = batch_get(xcdev);
+	if (!batch || batch->file != file) {
+		pr_info("%s, NO batch ring mapped.\n", xcdev->name);
+		rv = -EINVAL;
+		goto put_batch;
+	}
+
+	mutex_lock(&batch->submit_lock);
+	sq_tail = READ_ONCE(batch->hdr->sq_tail);
+	smp_rmb();
+	while (batch->sq_head != sq_tail) {
+		struct qdma_batch_sqe sqe;
+		struct batch_req *breq;
+		ssize_t res;
+
+		spin_lock(&batch->lock);
+		if (batch_cq_pending(batch) + batch->inflight >=
+		    batch->ring_sz) {
+			spin_unlock(&batch->lock);
+			break;
+		}
+		breq = list_first_entry(&batch->free_list, struct batch_req,
+					list);
+		list_del(&breq->list);
+		batch->inflight++;
+		batch->users++;
+		spin_unlock(&batch->lock);
+
+		/* the application may scribble on the ring, work on a copy */
+		memcpy(&sqe, batch->sqe + (batch->sq_head & (batch->ring_sz - 1)),
+			sizeof(struct qdma_batch_sqe));
+		batch->sq_head++;
+		WRITE_ONCE(batch->hdr->sq_head, batch->sq_head);
+		submitted++;
+
+		breq->user_data = sqe.user_data;
+		res = batch_req_prep(batch, breq, &sqe);
+		if (!res)
+			res = xcdev->fp_rw(xcdev->xcb->xpdev->dev_hndl,
+					xcdev->priv_data, &breq->req);
+		/* not queued, complete it right away */
+		if (res)
+			batch_req_done(&breq->req, res < 0 ? 0 : res,
+					res < 0 ? res : 0);
+	}
+	mutex_unlock(&batch->submit_lock);
+
+	if (ioc.min_complete) {
+		unsigned int min = min(ioc.min_complete, batch->ring_sz);
+
+		if (ioc.timeout_ms)
+			wait_event_interruptible_timeout(batch->wq,
+					batch_cq_pending(batch) >= min,
+					msecs_to_jiffies(ioc.timeout_ms));
+		else
+			wait_event_interruptible(batch->wq,
+					batch_cq_pending(batch) >= min);
+	}
+	rv = submitted;
+
+put_batch:
+	if (batch)
+		batch_put(batch);
+	return rv;
+}
+
+static void batch_vm_open(struct vm_area_struct *vma)
+{
+	struct cdev_batch *batch = vma->vm_private_data;
+
+	spin_lock(&batch->lock);
+	batch->users++;
+	spin_unlock(&batch->lock);
+}
+
+static void batch_vm_close(struct vm_area_struct *vma)
+{
+	batch_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct batch_vm_ops = {
+	.open = batch_vm_open,
+	.close = batch_vm_close,
+};
+
+static int cdev_batch_mmap(struct qdma_cdev *xcdev, struct file *file,
+			struct vm_area_struct *vma)
+{
+	unsigned long len = vma->vm_end - vma->vm_start;
+	struct qdma_queue_conf *qconf;
+	struct cdev_batch *batch;
+	unsigned int ring_sz;
+	unsigned long i;
+	int rv;
+
+	qconf = qdma_queue_get_config(xcdev->xcb->xpdev->dev_hndl,
+				xcdev->priv_data, NULL, 0);
+	if (!qconf)
+		return -EINVAL;
+	if (qconf->st && qconf->c2h) {
+		pr_info("%s, st c2h, NO batch ring.\n", xcdev->name);
+		return -EINVAL;
+	}
+
+	for (ring_sz = QDMA_BATCH_RING_SZ_MIN;
+	     ring_sz <= QDMA_BATCH_RING_SZ_MAX; ring_sz <<= 1)
+		if (QDMA_BATCH_MMAP_LEN(ring_sz, PAGE_SIZE) == len)
+			break;
+	if (ring_sz > QDMA_BATCH_RING_SZ_MAX) {
+		pr_info("%s, batch ring mmap len %lu NOT supported.\n",
+			xcdev->name, len);
+		return -EINVAL;
+	}
+
+	batch = kzalloc(sizeof(struct cdev_batch), GFP_KERNEL);
+	if (!batch)
+		return -ENOMEM;
+	batch->xcdev = xcdev;
+	batch->c2h = qconf->c2h;
+	batch->ring_sz = ring_sz;
+	batch->len = len;
+	batch->users = 1;
+	mutex_init(&batch->submit_lock);
+	spin_lock_init(&batch->lock);
+	INIT_LIST_HEAD(&batch->free_list);
+	init_waitqueue_head(&batch->wq);
+	INIT_WORK(&batch->free_work, batch_free_work);
+
+	batch->reqs = kcalloc(ring_sz, sizeof(struct batch_req), GFP_KERNEL);
+	batch->hdr = vmalloc_user(len);
+	if (!batch->reqs || !batch->hdr) {
+		pr_info("%s OOM, batch ring %u.\n", xcdev->name, ring_sz);
+		batch_free(batch);
+		return -ENOMEM;
+	}
+	for (i = 0; i < ring_sz; i++) {
+		batch->reqs[i].batch = batch;
+		list_add_tail(&batch->reqs[i].list, &batch->free_list);
+	}
+
+	batch->hdr->ring_sz = ring_sz;
+	batch->hdr->sq_offset = sizeof(struct qdma_batch_hdr);
+	batch->hdr->sqe_size = sizeof(struct qdma_batch_sqe);
+	batch->hdr->cq_offset = batch->hdr->sq_offset +
+				ring_sz * sizeof(struct qdma_batch_sqe);
+	batch->hdr->cqe_size = sizeof(struct qdma_batch_cqe);
+	batch->sqe = (void *)batch->hdr + batch->hdr->sq_offset;
+	batch->cqe = (void *)batch->hdr + batch->hdr->cq_offset;
+
+	spin_lock(&xcdev->lock);
+	if (xcdev->batch) {
+		spin_unlock(&xcdev->lock);
+		pr_info("%s, batch ring already mapped.\n", xcdev->name);
+		batch_free(batch);
+		return -EBUSY;
+	}
+	xcdev->batch = batch;
+	spin_unlock(&xcdev->lock);
+
+	/* whatever the ring refers to is tied to the file */
+	batch->file = get_file(file);
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	for (i = 0; i < len; i += PAGE_SIZE) {
+		rv = vm_insert_page(vma, vma->vm_start + i,
+				vmalloc_to_page((u8 *)batch->hdr + i));
+		if (rv < 0) {
+			pr_info("%s, batch ring insert page %lu failed %d.\n",
+				xcdev->name, i >> PAGE_SHIFT, rv);
+			batch_put(batch);
+			return rv;
+		}
+	}
+	vma->vm_private_data = batch;
+	vma->vm_ops = &batch_vm_ops;
+
+	return 0;
+}
+
 static ssize_t cdev_gen_write(struct file *file, const char __user *buf,
 				size_t count, loff_t *pos)
 {
@@ -263,13 +1506,258 @@ static ssize_t cdev_gen_read(struct file *file, char __user *buf,
 	return cdev_gen_read_write(file, (char *)buf, count, pos, 0);
 }
 
+/*
+ * asynchronous read/write (aio, io_uring): the request is submitted
+ * non-blocking and the kiocb completed from a work item once it is done,
+ * or, if polled (IOCB_HIPRI), from ->iopoll.
+ */
+struct cdev_async_io {
+	struct kiocb *kiocb;
+	struct work_struct work;
+	ssize_t res;
+	bool write;
+	bool polled;
+	int done;		/* polled: res is valid */
+
+	struct qdma_io_cb iocb;
+};
+
+static void cdev_kiocb_complete(struct kiocb *kiocb, ssize_t res)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,16,0)
+	kiocb->ki_complete(kiocb, res);
+#else
+	kiocb->ki_complete(kiocb, res, 0);
+#endif
+}
+
+static void cdev_async_io_free(struct cdev_async_io *aio)
+{
+	unmap_user_buf(&aio->iocb, aio->write);
+	iocb_release(&aio->iocb);
+	kfree(aio);
+}
+
+static void cdev_async_io_complete(struct work_struct *work)
+{
+	struct cdev_async_io *aio = container_of(work, struct cdev_async_io,
+						work);
+	struct kiocb *kiocb = aio->kiocb;
+	ssize_t res = aio->res;
+
+	/* dirtying the pages may sleep */
+	cdev_async_io_free(aio);
+	cdev_kiocb_complete(kiocb, res);
+}
+
+/* called with the queue lock held */
+static int cdev_async_io_done(struct qdma_sg_req *req, u64 bytes_done,
+				int err)
+{
+	struct cdev_async_io *aio = (struct cdev_async_io *)req->priv_data;
+
+	aio->res = err ? err : bytes_done;
+	if (aio->polled)
+		smp_store_release(&aio->done, 1);
+	else
+		queue_work(qdma_cdev_wq, &aio->work);
+	return 0;
+}
+
+static ssize_t cdev_async_io_submit(struct kiocb *kiocb, void __user *buf,
+				size_t count, bool write)
+{
+	struct qdma_cdev *xcdev =
+			(struct qdma_cdev *)kiocb->ki_filp->private_data;
+	struct cdev_async_io *aio;
+	struct qdma_sg_req *req;
+	ssize_t res;
+	int rv;
+
+	aio = kzalloc(sizeof(struct cdev_async_io), GFP_KERNEL);
+	if (!aio)
+		return -ENOMEM;
+	aio->kiocb = kiocb;
+	aio->write = write;
+	INIT_WORK(&aio->work, cdev_async_io_complete);
+#ifdef CDEV_IOPOLL
+	if (kiocb->ki_flags & IOCB_HIPRI) {
+		aio->polled = true;
+		kiocb->private = aio;
+	}
+#endif
+
+	aio->iocb.buf = buf;
+	aio->iocb.len = count;
+	aio->iocb.sgt = &aio->iocb.req.sgt;
+	rv = map_user_buf_to_sgl(&aio->iocb, write);
+	if (rv < 0) {
+		kfree(aio);
+		return rv;
+	}
+
+	req = &aio->iocb.req;
+	req->write = write;
+	req->dma_mapped = false;
+	req->ep_addr = (u64)kiocb->ki_pos;
+	req->count = count;
+	req->priv_data = (unsigned long)aio;
+	req->fp_done = cdev_async_io_done;
+
+	res = xcdev->fp_rw(xcdev->xcb->xpdev->dev_hndl, xcdev->priv_data, req);
+	if (res) {
+		/* failed, or the st c2h data was already there */
+		cdev_async_io_free(aio);
+		return res;
+	}
+
+	return -EIOCBQUEUED;
+}
+
+/* the iovec the iterator is at, a single user buffer counts as one */
+static const struct iovec *cdev_iter_iov(struct iov_iter *iter,
+					struct iovec *ubuf)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,4,0)
+	return iter_iov(iter);
+#else
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0)
+	if (iter_is_ubuf(iter)) {
+		ubuf->iov_base = iter->ubuf;
+		ubuf->iov_len = iter->iov_offset + iter->count;
+		return ubuf;
+	}
+#endif
+	return iter->iov;
+#endif
+}
+
+static ssize_t cdev_gen_read_write_iter(struct kiocb *kiocb,
+				struct iov_iter *iter, bool write)
+{
+	struct qdma_cdev *xcdev =
+			(struct qdma_cdev *)kiocb->ki_filp->private_data;
+	const struct iovec *iov;
+	struct iovec ubuf;
+	size_t count = iov_iter_count(iter);
+	size_t skip = iter->iov_offset;
+	ssize_t done = 0;
+	unsigned long i;
+
+	if (!xcdev || !xcdev->fp_rw)
+		return -EINVAL;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,0,0)
+	if (!user_backed_iter(iter))
+#else
+	if (!iter_is_iovec(iter))
+#endif
+		return -EINVAL;
+	if (!count)
+		return 0;
+	iov = cdev_iter_iov(iter, &ubuf);
+
+	/*
+	 * one user buffer per request: only a single segment goes out
+	 * asynchronously, a vector is done one segment at a time.
+	 */
+	if (!is_sync_kiocb(kiocb) && iter->nr_segs == 1) {
+		ssize_t res = cdev_async_io_submit(kiocb,
+					iov->iov_base + skip, count, write);
+
+		if (res > 0)
+			iov_iter_advance(iter, res);
+		return res;
+	}
+
+	for (i = 0; i < iter->nr_segs && count; i++, skip = 0) {
+		size_t len = min_t(size_t, iov[i].iov_len - skip, count);
+		loff_t pos = kiocb->ki_pos + done;
+		ssize_t res;
+
+		if (!len)
+			continue;
+
+		res = cdev_gen_read_write(kiocb->ki_filp,
+				iov[i].iov_base + skip, len, &pos, write);
+		if (res < 0) {
+			if (!done)
+				done = res;
+			break;
+		}
+		done += res;
+		count -= res;
+		if (res < len)
+			break;
+	}
+
+	if (done > 0)
+		iov_iter_advance(iter, done);
+	return done;
+}
+
+static ssize_t cdev_gen_write_iter(struct kiocb *kiocb, struct iov_iter *iter)
+{
+	return cdev_gen_read_write_iter(kiocb, iter, 1);
+}
+
+static ssize_t cdev_gen_read_iter(struct kiocb *kiocb, struct iov_iter *iter)
+{
+	return cdev_gen_read_write_iter(kiocb, iter, 0);
+}
+
+#ifdef CDEV_IOPOLL
+/*
+ * polled completion (io_uring IORING_SETUP_IOPOLL): process the queue's
+ * writebacks right here and complete the kiocb if that finished it,
+ * returns the # of requests completed.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,16,0)
+static int cdev_gen_iopoll(struct kiocb *kiocb, struct io_comp_batch *iob,
+			unsigned int flags)
+#else
+static int cdev_gen_iopoll(struct kiocb *kiocb, bool spin)
+#endif
+{
+	struct qdma_cdev *xcdev =
+			(struct qdma_cdev *)kiocb->ki_filp->private_data;
+	struct cdev_async_io *aio = kiocb->private;
+	ssize_t res;
+	int rv;
+
+	if (!aio)
+		return 0;
+
+	if (!smp_load_acquire(&aio->done)) {
+		rv = qdma_queue_service(xcdev->xcb->xpdev->dev_hndl,
+					xcdev->priv_data);
+		if (rv < 0)
+			return rv;
+		if (!smp_load_acquire(&aio->done))
+			return 0;
+	}
+
+	res = aio->res;
+	kiocb->private = NULL;
+	cdev_async_io_free(aio);
+	cdev_kiocb_complete(kiocb, res);
+	return 1;
+}
+#endif
+
 static const struct file_operations cdev_gen_fops = {
 	.owner = THIS_MODULE,
 	.open = cdev_gen_open,
 	.release = cdev_gen_close,
 	.write = cdev_gen_write,
 	.read = cdev_gen_read,
+	.write_iter = cdev_gen_write_iter,
+	.read_iter = cdev_gen_read_iter,
+#ifdef CDEV_IOPOLL
+	.iopoll = cdev_gen_iopoll,
+#endif
 	.unlocked_ioctl = cdev_gen_ioctl,
+	.poll = cdev_gen_poll,
+	.mmap = cdev_gen_mmap,
 	.llseek = cdev_gen_llseek,
 };
 
@@ -296,6 +1784,12 @@ void qdma_cdev_destroy(struct qdma_cdev *xcdev)
 
 	cdev_del(&xcdev->cdev);
 
+	/* asynchronous requests cancelled by the queue stop */
+	flush_workqueue(qdma_cdev_wq);
+
+	cdev_user_bufs_free(xcdev, NULL);
+	dma_pools_unpark(xcdev);
+
 	kfree(xcdev);
 }
 
@@ -321,6 +1815,8 @@ int qdma_cdev_create(struct qdma_cdev_cb *xcb, struct pci_dev *pdev,
 	}
 
 	spin_lock_init(&xcdev->lock);
+	INIT_LIST_HEAD(&xcdev->buf_list);
+	INIT_LIST_HEAD(&xcdev->dma_pool_parked);
 	xcdev->cdev.owner = THIS_MODULE;
 	xcdev->xcb = xcb;
 	xcdev->priv_data = qhndl;
@@ -430,11 +1926,20 @@ int qdma_cdev_device_init(struct qdma_cdev_cb *xcb)
 
 int qdma_cdev_init(void)
 {
+	qdma_cdev_wq = alloc_workqueue("%s_cdev", 0, 0, QDMA_CDEV_CLASS_NAME);
+	if (!qdma_cdev_wq) {
+		pr_info("%s: failed to create workqueue.",
+			QDMA_CDEV_CLASS_NAME);
+		return -1;
+	}
+
 	qdma_class = class_create(THIS_MODULE, QDMA_CDEV_CLASS_NAME);
 	if (IS_ERR(qdma_class)) {
 		pr_info("%s: failed to create class 0x%lx.",
 			QDMA_CDEV_CLASS_NAME, (unsigned long)qdma_class);
 		qdma_class = NULL;
+		destroy_workqueue(qdma_cdev_wq);
+		qdma_cdev_wq = NULL;
 		return -1;
 	}
 
@@ -445,4 +1950,7 @@ void qdma_cdev_cleanup(void)
 {
 	if (qdma_class)
 		class_destroy(qdma_class);
+	/* drains what is still queued */
+	if (qdma_cdev_wq)
+		destroy_workqueue(qdma_cdev_wq);
 }
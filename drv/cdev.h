@@ -22,6 +22,9 @@
 
 #define QDMA_MINOR_MAX (255)
 
+struct cdev_dma_pool;
+struct cdev_batch;
+
 /* per pci device control */
 struct qdma_cdev_cb {
 	struct xlnx_pci_dev *xpdev;
@@ -41,6 +44,15 @@ struct qdma_cdev {
 	struct cdev cdev;
 	unsigned long priv_data;
 
+	/* registered user buffers, protected by lock */
+	struct list_head buf_list;
+	unsigned int buf_cnt;
+	u32 buf_id_next;
+	/* mmap'ed dma pool and batch rings, protected by lock */
+	struct cdev_dma_pool *dma_pool;
+	struct list_head dma_pool_parked;	/* pools of failed transfers */
+	struct cdev_batch *batch;
+
 	int (*fp_open_extra)(struct qdma_cdev *);
 	int (*fp_close_extra)(struct qdma_cdev *);
 	long (*fp_ioctl_extra)(struct qdma_cdev *, unsigned int, unsigned long);
@@ -86,6 +86,8 @@ static int make_sw_context(struct qdma_descq *descq, u32 *data, int cnt)
 		  (1 << S_DESC_CTXT_W1_F_WB_ACC_EN) |
 		  (1 << S_DESC_CTXT_W1_F_WBI_CHK) |
 		  (V_DESC_CTXT_W1_FUNC_ID(descq->xdev->func_id)) |
+		  (V_DESC_CTXT_W1_RNG_SZ(descq->conf.rngsz_idx)) |
+		  (descq->conf.desc_bypass << S_DESC_CTXT_W1_F_BYP) |
 		  (1 << S_DESC_CTXT_W1_F_WBK_EN) |
 		  (descq->irq_en << S_DESC_CTXT_W1_F_IRQ_EN);
 
@@ -118,7 +120,8 @@ static int make_prefetch_context(struct qdma_descq *descq, u32 *data, int cnt)
 
 	/* prefetch context */
 	data[1] = 1 << S_PFTCH_W1_F_VALID;
-	data[0] = /* TODO buffer size index*/
+	data[0] = (descq->conf.pftch_bypass << S_PFTCH_W0_F_BYPASS) |
+		  (V_PFTCH_W0_BUF_SIZE_IDX(descq->conf.c2h_bufsz_idx)) |
 		  (V_PFTCH_W0_FNC_ID(descq->xdev->func_id)) |
 		  /* TODO port id*/
 		  (descq->prefetch_en << S_PFTCH_W0_F_EN_PFTCH);
@@ -152,10 +155,10 @@ static int make_wrb_context(struct qdma_descq *descq, u32 *data, int cnt)
 		  (descq->irq_en << S_WRB_CTXT_W0_F_EN_INT) |
 		  (V_WRB_CTXT_W0_TRIG_MODE(descq->wrb_trig_mode)) |
 		  (V_WRB_CTXT_W0_FNC_ID(descq->xdev->func_id)) |
-		  /* TODO timer index */
-		  /* TODO counter index */
+		  (V_WRB_CTXT_W0_TIMER_IDX(descq->wrb_timer_idx)) |
+		  (V_WRB_CTXT_W0_COUNTER_IDX(descq->wrb_cnt_idx)) |
 		  (1 << S_WRB_CTXT_W0_F_COLOR) |
-		  /* TODO ring size index (S_WRB_CTXT_W0_RNG_SZ(0)) | */
+		  (V_WRB_CTXT_W0_RNG_SZ(descq->conf.wrb_rngsz_idx)) |
 		  (V_WRB_CTXT_W0_BADDR_64(v));
 
 	data[1] = (bus_64 >> L_WRB_CTXT_W0_BADDR_64) & 0xFFFFFFFF;
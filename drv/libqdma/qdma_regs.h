@@ -26,6 +26,39 @@
 #define	C2H_CNT_TH_DFLT	0x1
 #define	C2H_BUF_SZ_DFLT	PAGE_SIZE
 
+/*
+ * desc. ring size profiles, one per global ring size register
+ * index 0 is the default (RNG_SZ_DFLT)
+ */
+#define	QDMA_RNG_SZ_PROFILE_CNT	16
+#define	RNG_SZ_DFLT_IDX		0
+
+extern const unsigned int qdma_rng_sz_profile[QDMA_RNG_SZ_PROFILE_CNT];
+
+/*
+ * st c2h buffer size profiles, one per global c2h buffer size register
+ * index 0 is the default (C2H_BUF_SZ_DFLT)
+ */
+#define	QDMA_C2H_BUF_SZ_CNT	16
+#define	C2H_BUF_SZ_DFLT_IDX	0
+
+extern const unsigned int qdma_c2h_buf_sz_profile[QDMA_C2H_BUF_SZ_CNT];
+
+/*
+ * st c2h writeback moderation: timer count and counter threshold profiles,
+ * one per global register, picked per queue by the wrb context / wrb cidx
+ * update. Index 0 is the default (C2H_TIMER_CNT_DFLT, C2H_CNT_TH_DFLT).
+ */
+#define	QDMA_C2H_TIMER_CNT_CNT	16
+#define	QDMA_C2H_CNT_TH_CNT	16
+
+extern const unsigned int qdma_c2h_timer_cnt_profile[QDMA_C2H_TIMER_CNT_CNT];
+extern const unsigned int qdma_c2h_cnt_th_profile[QDMA_C2H_CNT_TH_CNT];
+
+/* st h2c desc. length field is 16 bits */
+#define	ST_H2C_DESC_LEN_MAX	0xFFFF
+#define	ST_H2C_DESC_LEN_DFLT	PAGE_SIZE
+
 #ifndef __QDMA_VF__
 /*
  * PF only registers
@@ -73,6 +73,7 @@ static int qdma_thread_wrk_proc(struct list_head *work_item)
 		if (!descq->avail)
 			break;
 	}
+	qdma_descq_pidx_flush(descq);
 	unlock_descq(descq);
 
 	return 0;
@@ -85,7 +86,20 @@ static int qdma_thread_wb_pend(struct list_head *work_item)
 	int pend = 0;
 
 	lock_descq(descq);
-	pend = !list_empty(&descq->pend_list);
+	/*
+	 * the app hands rx ring entries back without telling, packet readers
+	 * wait for the rx queue to fill up. A queue left with writebacks after
+	 * its budget gets another pass after the other queues of the thread.
+	 */
+	pend = !list_empty(&descq->pend_list) || descq->rx_ring ||
+		descq->rx_pkt_waiters || descq->wb_more;
+	/*
+	 * pollers of the character device are woken by the writeback
+	 * processing, but in poll mode nothing tells about new writebacks:
+	 * look again once a jiffy rather than spin for them.
+	 */
+	if (!pend && descq->wbthp && waitqueue_active(&descq->poll_wq))
+		descq->wbthp->repoll = true;
 	unlock_descq(descq);
 
 	return pend;
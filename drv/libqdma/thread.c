@@ -59,7 +59,10 @@ static inline int xthread_work_pending(struct qdma_kthread *thp)
 }
 
 static inline void xthread_reschedule(struct qdma_kthread *thp) {
-	if (thp->timeout) {
+	if (thp->repoll) {
+		pr_debug("%s rescheduling for a re-poll", thp->name);
+		schedule_timeout(1);
+	} else if (thp->timeout) {
 		pr_debug("%s rescheduling for %u seconds",
 				thp->name, thp->timeout);
 		schedule_timeout(thp->timeout * HZ);
@@ -92,6 +95,7 @@ static int xthread_main(void *data)
 
 		/* any work to do? */
 		lock_thread(thp);
+		thp->repoll = false;
 		if (!xthread_work_pending(thp)) {
 			unlock_thread(thp);
 			xthread_reschedule(thp);
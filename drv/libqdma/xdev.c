@@ -499,28 +499,3 @@ void sgt_dump(struct sg_table *sgt)
 			i, sg, sg_page(sg), sg->offset, sg->length,
 			sg_dma_address(sg), sg_dma_len(sg)); 
 }
-
-int sgt_find_offset(struct sg_table *sgt, unsigned int offset,
-		struct scatterlist **sg_p, unsigned int *sg_offset)
-{
-	struct scatterlist *sg = sgt->sgl;
-	int max = sgt->nents;
-	unsigned int len = 0;
-	int i;
-
-	for (i = 0;  i < max; i++, sg = sg_next(sg)) {
-		len += sg_dma_len(sg);
-
-		if (len == offset) {
-			*sg_p = sg_next(sg);	
-			*sg_offset = 0;
-			return ++i;
-		} else if (len > offset) {
-			*sg_p = sg;	
-			*sg_offset = len - offset;
-			return i;
-		}
-	}
-
-	return -EINVAL;
-}
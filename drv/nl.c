@@ -46,6 +46,18 @@ static struct nla_policy xnl_policy[XNL_ATTR_MAX] = {
 	[XNL_ATTR_QBUFSZ] =	{ .type = NLA_U32 },
 	[XNL_ATTR_QIDX] =	{ .type = NLA_U32 },
 	[XNL_ATTR_WRB_DESC_SIZE] = { .type = NLA_U8 },
+	[XNL_ATTR_QRNGSZ_WRB] =	{ .type = NLA_U32 },
+	[XNL_ATTR_PIDX_DB_BATCH] = { .type = NLA_U32 },
+	[XNL_ATTR_ST_H2C_DESC_LEN] = { .type = NLA_U32 },
+	[XNL_ATTR_DEV_BYP_BAR] = { .type = NLA_U32 },
+	[XNL_ATTR_PFETCH_EN] = { .type = NLA_U32 },
+	[XNL_ATTR_WB_BUDGET] = { .type = NLA_U32 },
+	[XNL_ATTR_BUSY_POLL] = { .type = NLA_U32 },
+	[XNL_ATTR_TRIG_MODE] = { .type = NLA_U32 },
+	[XNL_ATTR_TIMER_IDX] = { .type = NLA_U32 },
+	[XNL_ATTR_CNT_IDX] = { .type = NLA_U32 },
+	[XNL_ATTR_RX_MAX_BYTES] = { .type = NLA_U32 },
+	[XNL_ATTR_RX_MAX_PKTS] = { .type = NLA_U32 },
 };
 
 static int xnl_dev_list(struct sk_buff *, struct genl_info *);
@@ -344,9 +356,10 @@ static int qconf_get(struct qdma_queue_conf *qconf, struct genl_info *info,
 	}
 
 	memset(qconf, 0, sizeof(*qconf));
-	//qconf.qsize = nla_get_u32(info->attrs[XNL_ATTR_QRNGSZ]);
 	qconf->st = (f & XNL_F_QMODE_ST) ? 1 : 0;
 	qconf->c2h = (f & XNL_F_QDIR_C2H) ? 1 : 0;
+	qconf->inline_submit = (f & XNL_F_INLINE_SUBMIT) ? 1 : 0;
+	qconf->desc_bypass = (f & XNL_F_DESC_BYPASS) ? 1 : 0;
 
 	qconf->qidx = nla_get_u32(info->attrs[XNL_ATTR_QIDX]);
 	if (qconf->qidx == XNL_QIDX_INVALID)
@@ -359,6 +372,20 @@ err_out:
 	return -EINVAL;
 }
 
+/* fetch a u32 attribute destined for a narrower qconf field */
+static int xnl_attr_get_u32(struct genl_info *info, enum xnl_attr_t attr,
+			u32 max, u32 *v, char *buf, int buflen)
+{
+	*v = nla_get_u32(info->attrs[attr]);
+	if (*v <= max)
+		return 0;
+
+	snprintf(buf, buflen, "ERR! %s %u invalid, max %u.\n",
+		xnl_attr_str[attr], *v, max);
+	xnl_respond_buffer(info, buf, buflen);
+	return -EINVAL;
+}
+
 static struct xlnx_qdata *xnl_rcv_check_qidx(struct genl_info *info,
 				struct xlnx_pci_dev *xpdev,
 				struct qdma_queue_conf *qconf, char *buf,
@@ -458,6 +485,12 @@ static int xnl_dev_info(struct sk_buff *skb2, struct genl_info *info)
 		pr_err("xnl_msg_add_attr_uint() failed: 0x%x", rv);
 		return rv;
 	}
+	rv = xnl_msg_add_attr_uint(skb, XNL_ATTR_DEV_BYP_BAR,
+				conf->bar_num_bypass);
+	if (rv < 0) {
+		pr_err("xnl_msg_add_attr_uint() failed: 0x%x", rv);
+		return rv;
+	}
 	rv = xnl_msg_add_attr_uint(skb, XNL_ATTR_DEV_QSET_MAX, conf->qsets_max);
 	if (rv < 0) {
 		pr_err("xnl_msg_add_attr_uint() failed: 0x%x", rv);
@@ -501,8 +534,10 @@ free_msg_buff:
 static int xnl_q_add(struct sk_buff *skb2, struct genl_info *info)
 {
 	struct xlnx_pci_dev *xpdev;
+	struct qdma_dev_conf *conf;
 	struct qdma_queue_conf qconf;
 	char buf[XNL_RESP_BUFLEN_MIN];
+	u32 v;
 	int rv;
 
 	if (info == NULL)
@@ -510,7 +545,7 @@ static int xnl_q_add(struct sk_buff *skb2, struct genl_info *info)
 
 	xnl_dump_attrs(info);
 
-	xpdev = xnl_rcv_check_xpdev(info, NULL);
+	xpdev = xnl_rcv_check_xpdev(info, &conf);
 	if (!xpdev)
 		return 0;
 
@@ -518,9 +553,97 @@ static int xnl_q_add(struct sk_buff *skb2, struct genl_info *info)
 	if (rv < 0)
 		return rv;
 
-	if (qconf.c2h && qconf.st)
+	if (info->attrs[XNL_ATTR_QRNGSZ]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_QRNGSZ, U8_MAX, &v, buf,
+					XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.rngsz_idx = v;
+	}
+
+	if (info->attrs[XNL_ATTR_PIDX_DB_BATCH]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_PIDX_DB_BATCH, U16_MAX,
+					&v, buf, XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.pidx_db_batch = v;
+	}
+
+	if (info->attrs[XNL_ATTR_ST_H2C_DESC_LEN])
+		qconf.st_h2c_desc_len_max =
+			nla_get_u32(info->attrs[XNL_ATTR_ST_H2C_DESC_LEN]);
+
+	if (qconf.c2h && qconf.st) {
 	    qconf.st_c2h_wrb_desc_size =
 			    nla_get_u8(info->attrs[XNL_ATTR_WRB_DESC_SIZE]);
+	    if (info->attrs[XNL_ATTR_QRNGSZ_WRB]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_QRNGSZ_WRB, U8_MAX, &v,
+					buf, XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.wrb_rngsz_idx = v;
+	    }
+	    if (info->attrs[XNL_ATTR_QBUFSZ]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_QBUFSZ, U8_MAX, &v, buf,
+					XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.c2h_bufsz_idx = v;
+	    }
+	    /* left unset, libqdma applies the device wide prefetch setting */
+	    if (info->attrs[XNL_ATTR_PFETCH_EN]) {
+		if (nla_get_u32(info->attrs[XNL_ATTR_PFETCH_EN]))
+			qconf.pftch_en = 1;
+		else
+			qconf.pftch_dis = 1;
+	    }
+	    qconf.pftch_bypass =
+			nla_get_u32(info->attrs[XNL_ATTR_QFLAG]) &
+			XNL_F_PFETCH_BYPASS ? 1 : 0;
+	    if (info->attrs[XNL_ATTR_WB_BUDGET]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_WB_BUDGET, U16_MAX, &v,
+					buf, XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.wb_budget = v;
+	    }
+	    if (info->attrs[XNL_ATTR_BUSY_POLL])
+		qconf.busy_poll_us =
+			nla_get_u32(info->attrs[XNL_ATTR_BUSY_POLL]);
+	    if (info->attrs[XNL_ATTR_TRIG_MODE]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_TRIG_MODE, U8_MAX, &v,
+					buf, XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.wrb_trig_mode = v;
+	    }
+	    if (info->attrs[XNL_ATTR_TIMER_IDX]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_TIMER_IDX, U8_MAX, &v,
+					buf, XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.wrb_timer_idx = v;
+	    }
+	    if (info->attrs[XNL_ATTR_CNT_IDX]) {
+		rv = xnl_attr_get_u32(info, XNL_ATTR_CNT_IDX, U8_MAX, &v,
+					buf, XNL_RESP_BUFLEN_MIN);
+		if (rv < 0)
+			return rv;
+		qconf.wrb_cnt_idx = v;
+	    }
+	    qconf.adaptive_coal =
+			nla_get_u32(info->attrs[XNL_ATTR_QFLAG]) &
+			XNL_F_ADAPTIVE_COAL ? 1 : 0;
+	    if (info->attrs[XNL_ATTR_RX_MAX_BYTES])
+		qconf.rx_max_bytes =
+			nla_get_u32(info->attrs[XNL_ATTR_RX_MAX_BYTES]);
+	    if (info->attrs[XNL_ATTR_RX_MAX_PKTS])
+		qconf.rx_max_pkts =
+			nla_get_u32(info->attrs[XNL_ATTR_RX_MAX_PKTS]);
+	    qconf.rx_drop_oldest =
+			nla_get_u32(info->attrs[XNL_ATTR_QFLAG]) &
+			XNL_F_RX_DROP_OLDEST ? 1 : 0;
+	}
 
 	rv = xpdev_queue_add(xpdev, &qconf, buf, XNL_RESP_BUFLEN_MIN);
 	if (rv < 0) {
@@ -35,6 +35,22 @@ enum q_parm_type {
         QPARM_DESC,
         QPARM_WRB,
         QPARM_WRBSZ,
+        QPARM_RNGSZ_WRB,
+        QPARM_PIDX_DB_BATCH,
+        QPARM_DESC_LEN,
+        QPARM_INLINE,
+        QPARM_BYPASS,
+        QPARM_PFETCH,
+        QPARM_PFETCH_BYPASS,
+        QPARM_WB_BUDGET,
+        QPARM_BUSY_POLL,
+        QPARM_TRIG_MODE,
+        QPARM_TIMER_IDX,
+        QPARM_CNT_IDX,
+        QPARM_ADAPTIVE,
+        QPARM_RX_BYTES,
+        QPARM_RX_PKTS,
+        QPARM_RX_DROP,
 
         QPARM_MAX,
 };
@@ -44,6 +60,11 @@ enum q_parm_type {
 #define XNL_F_QDIR_H2C	0x4
 #define XNL_F_QDIR_C2H	0x8
 #define XNL_F_CDEV	0x10
+#define XNL_F_INLINE_SUBMIT	0x20
+#define XNL_F_DESC_BYPASS	0x40
+#define XNL_F_PFETCH_BYPASS	0x80
+#define XNL_F_ADAPTIVE_COAL	0x100
+#define XNL_F_RX_DROP_OLDEST	0x200
 
 /*
  * attributes (variables):
@@ -78,6 +99,19 @@ enum xnl_attr_t {
 	XNL_ATTR_RANGE_START,
 	XNL_ATTR_RANGE_END,
 
+	XNL_ATTR_QRNGSZ_WRB,
+	XNL_ATTR_PIDX_DB_BATCH,
+	XNL_ATTR_ST_H2C_DESC_LEN,
+	XNL_ATTR_DEV_BYP_BAR,
+	XNL_ATTR_PFETCH_EN,
+	XNL_ATTR_WB_BUDGET,
+	XNL_ATTR_BUSY_POLL,
+	XNL_ATTR_TRIG_MODE,
+	XNL_ATTR_TIMER_IDX,
+	XNL_ATTR_CNT_IDX,
+	XNL_ATTR_RX_MAX_BYTES,
+	XNL_ATTR_RX_MAX_PKTS,
+
 	XNL_ATTR_MAX,
 };
 
@@ -106,13 +140,28 @@ static const char xnl_attr_str[][12] = {
 	"REG_ADDR",	/* XNL_ATTR_REG_ADDR */
 	"REG_VAL",	/* XNL_ATTR_REG_VAL */
 
+	"QIDX",		/* XNL_ATTR_QIDX */
 	"QFLAG",	/* XNL_ATTR_QFLAG */
 	"QRINGSZ",	/* XNL_ATTR_QRNGSZ */
 	"QBUFSZ",	/* XNL_ATTR_QBUFSZ */
-	"QIDX",		/* XNL_ATTR_QIDX */
+
+	"WRB_DESC_SZ",	/* XNL_ATTR_WRB_DESC_SIZE */
 
 	"RANGE_START",	/* XNL_ATTR_RANGE_START */
 	"RANGE_END",	/* XNL_ATTR_RANGE_END */
+
+	"QRINGSZ_WRB",	/* XNL_ATTR_QRNGSZ_WRB */
+	"PIDX_BATCH",	/* XNL_ATTR_PIDX_DB_BATCH */
+	"H2CDESC_LEN",	/* XNL_ATTR_ST_H2C_DESC_LEN */
+	"DEV_BYP_BAR",	/* XNL_ATTR_DEV_BYP_BAR */
+	"PFETCH_EN",	/* XNL_ATTR_PFETCH_EN */
+	"WB_BUDGET",	/* XNL_ATTR_WB_BUDGET */
+	"BUSY_POLL",	/* XNL_ATTR_BUSY_POLL */
+	"TRIG_MODE",	/* XNL_ATTR_TRIG_MODE */
+	"TIMER_IDX",	/* XNL_ATTR_TIMER_IDX */
+	"CNT_IDX",	/* XNL_ATTR_CNT_IDX */
+	"RX_MAX_BYTE",	/* XNL_ATTR_RX_MAX_BYTES */
+	"RX_MAX_PKTS",	/* XNL_ATTR_RX_MAX_PKTS */
 };
 
 /* commands, 0 ~ 0x7F */
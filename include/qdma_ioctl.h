@@ -0,0 +1,301 @@
+/*
+ * This file is part of the Xilinx DMA IP Core driver for Linux
+ *
+ * Copyright (c) 2017-present,  Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under both the BSD-style license (found in the
+ * LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ * in the COPYING file in the root directory of this source tree).
+ * You may select, at your option, one of the above-listed licenses.
+ */
+
+#ifndef __QDMA_IOCTL_H__
+#define __QDMA_IOCTL_H__
+
+/*
+ * interface of the per queue character device beyond read/write,
+ * shared between the driver and the applications
+ */
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define QDMA_IOC_MAGIC		'q'
+
+/* max. # of bytes of user defined data in a st c2h writeback entry */
+#define QDMA_C2H_UDD_MAX	64
+
+/*
+ * ST C2H receive ring
+ *
+ * mmap() of an ST C2H queue's character device at QDMA_RX_RING_MMAP_OFFSET
+ * switches the queue to zero-copy receive until it is stopped. The mapping
+ * of QDMA_RX_RING_MMAP_LEN(ring size, page size, buffer stride) bytes is
+ * laid out as:
+ *
+ *	0		struct qdma_rx_ring_hdr
+ *	ent_offset	struct qdma_rx_ring_ent x ring_sz
+ *	buf_offset	buf_cnt receive buffers, buf_stride apart
+ *
+ * The device fills up to buf_size bytes of a buffer before moving on to
+ * the next one. buf_stride is buf_size rounded up to a power of 2 number of
+ * pages, see qdma_rx_ring_buf_stride().
+ *
+ * For every packet received the driver fills in the entry at pidx then
+ * advances pidx. The data sits in buf_cnt consecutive buffers (wrapping
+ * around) starting at buf_idx. A packet the device reported an error on
+ * is posted all the same, flagged QDMA_RX_RING_F_ERR. Once done with the packet the application
+ * advances cidx, which hands the entry and its buffers back to the driver.
+ * Both indexes wrap at ring_sz, the ring is empty when pidx == cidx.
+ *
+ * The driver picks up cidx whenever it processes the writebacks. Once the
+ * device has run out of buffers, or the ring has filled up, nothing may
+ * trigger that any more: QDMA_IOCTL_RX_RING_KICK has the driver look at
+ * cidx right away.
+ */
+#define QDMA_RX_RING_MMAP_OFFSET	0
+
+struct qdma_rx_ring_hdr {
+	/* set up by the driver, read-only */
+	__u32 ring_sz;		/* # of entries */
+	__u32 ent_offset;	/* offset of entry 0 */
+	__u32 ent_size;		/* sizeof(struct qdma_rx_ring_ent) */
+	__u32 buf_cnt;		/* # of receive buffers */
+	__u32 buf_size;		/* # of data bytes per receive buffer */
+	__u32 buf_stride;	/* distance between two buffers */
+	__u32 buf_offset;	/* offset of buffer 0, page aligned */
+	/* written by the driver */
+	__u32 pidx __attribute__((aligned(64)));
+	/* written by the application */
+	__u32 cidx __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+struct qdma_rx_ring_ent {
+	__u32 buf_idx;		/* first buffer of the packet */
+	__u32 len;		/* packet length in bytes */
+	__u16 buf_cnt;		/* # of buffers used, 0 if no data */
+	__u16 udd_len;		/* # of bytes valid in udd[] */
+	__u32 flags;		/* QDMA_RX_RING_F_XXX */
+	__u8 udd[QDMA_C2H_UDD_MAX];	/* user defined data, if enabled */
+};
+
+#define QDMA_RX_RING_F_ERR	0x1	/* the device reported an error */
+
+#define QDMA_RX_RING_LEN(ring_sz, pg_sz) \
+	((sizeof(struct qdma_rx_ring_hdr) + \
+	  (ring_sz) * sizeof(struct qdma_rx_ring_ent) + (pg_sz) - 1) & \
+	 ~((unsigned long)(pg_sz) - 1))
+#define QDMA_RX_RING_MMAP_LEN(ring_sz, pg_sz, buf_stride) \
+	(QDMA_RX_RING_LEN(ring_sz, pg_sz) + \
+	 (ring_sz) * (unsigned long)(buf_stride))
+
+static inline unsigned long qdma_rx_ring_buf_stride(unsigned int buf_size,
+						unsigned long pg_sz)
+{
+	while (pg_sz < buf_size)
+		pg_sz <<= 1;
+	return pg_sz;
+}
+
+#define QDMA_IOCTL_RX_RING_KICK		_IO(QDMA_IOC_MAGIC, 1)
+
+/*
+ * ST C2H packet mode receive
+ *
+ * QDMA_IOCTL_RECV_PKTS copies up to pkt_max whole packets back to back into
+ * buf and describes each of them in the pkts array. It first waits for at
+ * least pkt_min packets to be queued (0: no wait), for up to timeout_ms
+ * (0: no timeout). A packet that does not fit into what is left of buf is
+ * cut short and flagged QDMA_PKT_F_TRUNC, the rest of it is dropped.
+ */
+#define QDMA_PKT_F_ERR		0x1	/* the device reported an error */
+#define QDMA_PKT_F_TRUNC	0x2	/* did not fit into buf */
+
+struct qdma_pkt_desc {
+	__u64 offset;		/* of the packet data in buf */
+	__u32 len;		/* # of data bytes copied */
+	__u16 flags;		/* QDMA_PKT_F_XXX */
+	__u16 udd_len;		/* # of bytes valid in udd[] */
+	__u8 udd[QDMA_C2H_UDD_MAX];
+};
+
+struct qdma_ioc_recv_pkts {
+	__u64 buf;		/* data buffer */
+	__u64 buf_len;
+	__u64 pkts;		/* struct qdma_pkt_desc x pkt_max */
+	__u32 pkt_max;
+	__u32 pkt_min;
+	__u32 timeout_ms;
+	__u32 pkt_cnt;		/* out: # of packets received */
+	__u64 bytes;		/* out: # of bytes copied into buf */
+};
+
+#define QDMA_IOCTL_RECV_PKTS	_IOWR(QDMA_IOC_MAGIC, 2, \
+					struct qdma_ioc_recv_pkts)
+
+/*
+ * registered buffers
+ *
+ * QDMA_IOCTL_BUF_REG pins down and dma maps the len bytes at addr once and
+ * hands back an id for them. The buffer has to be writable. It stays
+ * registered until QDMA_IOCTL_BUF_UNREG, or until the file it was
+ * registered through is closed.
+ *
+ * QDMA_IOCTL_BUF_IO then moves len bytes between the queue and the
+ * registered buffer at offset, in the queue's direction, without pinning
+ * or mapping anything. ep_addr is the device memory address of a MM queue.
+ */
+struct qdma_ioc_buf_reg {
+	__u64 addr;
+	__u64 len;
+	__u32 id;		/* out */
+	__u32 rsvd;
+};
+
+struct qdma_ioc_buf_io {
+	__u32 id;
+	__u32 rsvd;
+	__u64 offset;		/* into the registered buffer */
+	__u64 len;
+	__u64 ep_addr;
+	__u64 bytes;		/* out: # of bytes transferred */
+};
+
+#define QDMA_IOCTL_BUF_REG	_IOWR(QDMA_IOC_MAGIC, 3, struct qdma_ioc_buf_reg)
+#define QDMA_IOCTL_BUF_UNREG	_IOW(QDMA_IOC_MAGIC, 4, __u32)
+#define QDMA_IOCTL_BUF_IO	_IOWR(QDMA_IOC_MAGIC, 5, struct qdma_ioc_buf_io)
+
+/*
+ * DMA pool
+ *
+ * mmap() of a MM or ST H2C queue's character device at
+ * QDMA_DMA_POOL_MMAP_OFFSET allocates a dma coherent buffer of the mapping's
+ * length (up to QDMA_DMA_POOL_LEN_MAX), close to the device, and maps it
+ * into the application. A queue has one pool at a time, it goes away with
+ * the last mapping of it.
+ *
+ * The application builds the data in place, QDMA_IOCTL_POOL_XFER then
+ * transfers len bytes at offset into the pool without pinning or mapping
+ * anything, and returns the # of bytes transferred.
+ */
+#define QDMA_DMA_POOL_MMAP_OFFSET	0x10000000
+#define QDMA_DMA_POOL_LEN_MAX		(4 << 20)
+
+struct qdma_ioc_pool_xfer {
+	__u64 offset;		/* into the pool */
+	__u64 len;
+	__u64 ep_addr;		/* device memory address of a MM queue */
+	__u32 flags;		/* reserved, 0 */
+	__u32 rsvd;
+};
+
+#define QDMA_IOCTL_POOL_XFER	_IOW(QDMA_IOC_MAGIC, 6, \
+					struct qdma_ioc_pool_xfer)
+
+/*
+ * batch submission (MM and ST H2C queues)
+ *
+ * mmap() of the queue's character device at QDMA_BATCH_MMAP_OFFSET, with a
+ * length of QDMA_BATCH_MMAP_LEN(ring size, page size) for a power of 2 ring
+ * size between QDMA_BATCH_RING_SZ_MIN and QDMA_BATCH_RING_SZ_MAX, sets up a
+ * submission ring and a completion ring of that size:
+ *
+ *	0		struct qdma_batch_hdr
+ *	sq_offset	struct qdma_batch_sqe x ring_sz
+ *	cq_offset	struct qdma_batch_cqe x ring_sz
+ *
+ * The application fills in sqes at sq_tail and advances it, then calls
+ * QDMA_IOCTL_BATCH_SUBMIT: the driver consumes the entries up to sq_tail,
+ * advancing sq_head, and queues the transfers without waiting for them.
+ * Each transfer, once done, gets a cqe at cq_tail. The application
+ * advances cq_head past the cqes it has handled. All indexes are free
+ * running, the entry of index i is at i & (ring_sz - 1).
+ *
+ * Entries are only consumed while the completion ring has room for them,
+ * the return value of QDMA_IOCTL_BATCH_SUBMIT is the # of entries
+ * consumed. With min_complete set it then waits for that many cqes to be
+ * pending, for up to timeout_ms (0: no timeout).
+ *
+ * A sqe names its data either by a registered buffer id (QDMA_IOCTL_BUF_REG)
+ * and offset, or by an offset into the queue's dma pool with
+ * QDMA_BATCH_F_POOL. The ring must be submitted to through the file it was
+ * mapped through, and goes away with the last mapping of it.
+ */
+#define QDMA_BATCH_MMAP_OFFSET		0x20000000
+#define QDMA_BATCH_RING_SZ_MIN		8
+#define QDMA_BATCH_RING_SZ_MAX		4096
+
+#define QDMA_BATCH_F_POOL		0x1	/* offset into the dma pool */
+
+struct qdma_batch_hdr {
+	/* set up by the driver, read-only */
+	__u32 ring_sz;
+	__u32 sq_offset;
+	__u32 sqe_size;		/* sizeof(struct qdma_batch_sqe) */
+	__u32 cq_offset;
+	__u32 cqe_size;		/* sizeof(struct qdma_batch_cqe) */
+	/* written by the application */
+	__u32 sq_tail __attribute__((aligned(64)));
+	/* written by the driver */
+	__u32 sq_head __attribute__((aligned(64)));
+	/* written by the driver */
+	__u32 cq_tail __attribute__((aligned(64)));
+	/* written by the application */
+	__u32 cq_head __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+struct qdma_batch_sqe {
+	__u64 user_data;	/* passed back in the cqe */
+	__u64 offset;		/* into the buffer */
+	__u64 ep_addr;		/* device memory address of a MM queue */
+	__u32 len;
+	__u32 buf_id;		/* registered buffer, w/o QDMA_BATCH_F_POOL */
+	__u32 flags;		/* QDMA_BATCH_F_XXX */
+	__u32 rsvd;
+};
+
+struct qdma_batch_cqe {
+	__u64 user_data;
+	__s32 res;		/* # of bytes transferred, or -errno */
+	__u32 rsvd;
+};
+
+#define QDMA_BATCH_MMAP_LEN(ring_sz, pg_sz) \
+	((sizeof(struct qdma_batch_hdr) + \
+	  (ring_sz) * (sizeof(struct qdma_batch_sqe) + \
+		       sizeof(struct qdma_batch_cqe)) + (pg_sz) - 1) & \
+	 ~((unsigned long)(pg_sz) - 1))
+
+struct qdma_ioc_batch_submit {
+	__u32 min_complete;
+	__u32 timeout_ms;
+};
+
+#define QDMA_IOCTL_BATCH_SUBMIT	_IOW(QDMA_IOC_MAGIC, 7, \
+					struct qdma_ioc_batch_submit)
+
+/*
+ * MM gather/scatter
+ *
+ * QDMA_IOCTL_RW_SEGS moves seg_nr (host buffer, card address, length)
+ * ranges, in the queue's direction, as one request: one descriptor chain,
+ * one doorbell and one completion. It returns the total # of bytes
+ * transferred.
+ */
+#define QDMA_RW_SEGS_MAX	256
+
+struct qdma_ioc_seg {
+	__u64 buf;		/* host buffer */
+	__u64 ep_addr;		/* card memory address */
+	__u64 len;
+};
+
+struct qdma_ioc_rw_segs {
+	__u64 segs;		/* struct qdma_ioc_seg x seg_nr */
+	__u32 seg_nr;
+	__u32 rsvd;
+};
+
+#define QDMA_IOCTL_RW_SEGS	_IOW(QDMA_IOC_MAGIC, 8, struct qdma_ioc_rw_segs)
+
+#endif /* ifndef __QDMA_IOCTL_H__ */
@@ -14,6 +14,9 @@
 
 #include "libqdma_export.h"
 
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
 #include "qdma_descq.h"
 #include "qdma_device.h"
 #include "qdma_thread.h"
@@ -24,6 +27,45 @@
 
 /* ********************* static function definitions ************************ */
 
+/*
+ * st c2h busy poll: process the writebacks in the caller's context until
+ * done() or conf.busy_poll_us is up, rather than waiting for the interrupt
+ * or the thread to get to them
+ */
+static bool st_c2h_busy_poll(struct qdma_descq *descq,
+			bool (*done)(struct qdma_descq *, void *), void *arg)
+{
+	u64 end = ktime_get_ns() +
+		(u64)descq->conf.busy_poll_us * NSEC_PER_USEC;
+
+	do {
+		qdma_descq_service_wb(descq);
+		if (done(descq, arg)) {
+			lock_descq(descq);
+			descq->stat_busy_poll++;
+			unlock_descq(descq);
+			return true;
+		}
+		cpu_relax();
+	} while (ktime_get_ns() < end && !need_resched() &&
+		 !signal_pending(current));
+
+	return false;
+}
+
+static bool st_c2h_req_done(struct qdma_descq *descq, void *arg)
+{
+	return ((struct qdma_sgt_req_cb *)arg)->done;
+}
+
+static bool st_c2h_pkts_ready(struct qdma_descq *descq, void *arg)
+{
+	struct st_rx_queue *rxq = &descq->rx_queue;
+
+	return rxq->pkt_cnt >= ((struct qdma_pkt_req *)arg)->pkt_min ||
+		rxq->stalled || rxq->capped;
+}
+
 static ssize_t qdma_sg_req_submit_st_c2h(struct xlnx_dma_dev *xdev,
 			struct qdma_descq *descq, struct qdma_sg_req *req)
 {
@@ -35,6 +77,13 @@ static ssize_t qdma_sg_req_submit_st_c2h(struct xlnx_dma_dev *xdev,
 	int wait = req->fp_done ? 0 : 1;
 	int rv = 0;
 
+	/* the rx queue is accounted in 32 bits */
+	if (req->count > UINT_MAX) {
+		pr_info("%s: req 0x%p, %llu too big.\n",
+			descq->conf.name, req, req->count);
+		return -EINVAL;
+	}
+
 	spin_lock(&rxq->lock);
 	avail = rxq->dlen;
 	spin_unlock(&rxq->lock);
@@ -42,11 +91,18 @@ static ssize_t qdma_sg_req_submit_st_c2h(struct xlnx_dma_dev *xdev,
 	if (avail >= req->count) {
 		cb->offset = req->count;
 		goto copy_data;
-	} else
+	} else if (wait)
 		cb->offset = req->count - avail;
+	else
+		/* completed with the data copied in, see rx_request_done() */
+		cb->offset = req->count;
 
 	lock_descq(descq);
-	if (descq->online) {
+	if (descq->rx_ring) {
+		unlock_descq(descq);
+		pr_info("%s: rx ring mmap'ed, NO read.\n", descq->conf.name);
+		return -EBUSY;
+	} else if (descq->online) {
 		list_add_tail(&cb->list, &descq->pend_list);
 		unlock_descq(descq);
 	} else {
@@ -58,13 +114,19 @@ static ssize_t qdma_sg_req_submit_st_c2h(struct xlnx_dma_dev *xdev,
 
 	if (descq->wbthp)
 		qdma_kthread_wakeup(descq->wbthp);
+	else if (rxq->stalled)
+		/* no interrupt comes until the wrb processing resumes */
+		qdma_descq_service_wb(descq);
 
 	if (!wait) {
-		pr_info("%s: cb 0x%p, 0x%x NO wait.\n",
+		pr_debug("%s: cb 0x%p, 0x%llx NO wait.\n",
 			descq->conf.name, cb, req->count);
 		return 0;
 	}
 
+	if (descq->conf.busy_poll_us)
+		st_c2h_busy_poll(descq, st_c2h_req_done, cb);
+
 	if (req->timeout_ms)
 		wait_event_interruptible_timeout(cb->wq, cb->done,
 			msecs_to_jiffies(req->timeout_ms));
@@ -73,25 +135,27 @@ static ssize_t qdma_sg_req_submit_st_c2h(struct xlnx_dma_dev *xdev,
 
 	if (!cb->done) { /* timed out */
 		char* buf = kmalloc(2048, GFP_KERNEL);
-		pr_info("%s: cb 0x%p, req 0x%x, timed out.\n",
+		pr_info("%s: cb 0x%p, req 0x%llx, timed out.\n",
 			descq->conf.name, cb, req->count);
 		qdma_queue_dump((unsigned long)xdev,
 				descq->conf.qidx + qdev->qmax, buf, 2048);
 		pr_info("%s", buf);
 		kfree(buf);
+		/* the request may have completed since the wait gave up */
 		lock_descq(descq);
-		list_del(&cb->list);
+		if (!cb->done)
+			list_del(&cb->list);
 		unlock_descq(descq);
 	}
 
 	if (!cb->done || cb->status) {
-		pr_info("%s: 0x%p, %u, tm %u, off %u, err 0x%x, cmpl %d.\n",
+		pr_info("%s: 0x%p, %llu, tm %u, off %llu, err 0x%x, cmpl %d.\n",
 			descq->conf.name, req, req->count, req->timeout_ms,
 			cb->offset, cb->status, cb->done);
 	}
 
 copy_data:
-	pr_debug("%s: cb 0x%p, req 0x%x, copy data, %u, ...\n",
+	pr_debug("%s: cb 0x%p, req 0x%llx, copy data, %u, ...\n",
 		descq->conf.name, cb, req->count, rxq->dlen);
 	/* copy data from rx queue */
     rv = qdma_descq_rxq_read(descq, sgt, req->count);
@@ -250,6 +314,7 @@ int qdma_queue_config(unsigned long dev_hndl, unsigned long qid,
 	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
 	struct qdma_dev *qdev = xdev_2_qdev(xdev);
 	struct qdma_descq *descq = NULL;
+	int rv;
 
 	descq = qdma_device_get_descq_by_id(xdev, qid, NULL, 0, 0);
 	if (!descq) {
@@ -275,7 +340,20 @@ int qdma_queue_config(unsigned long dev_hndl, unsigned long qid,
 	spin_unlock(&qdev->lock);
 
 	/* configure descriptor queue */
-	qdma_descq_config(descq, qconf, 0);
+	rv = qdma_descq_config(descq, qconf, 0, buf, buflen);
+	if (rv < 0) {
+		spin_lock(&qdev->lock);
+		if (qconf->c2h)
+			qdev->c2h_qcnt--;
+		else
+			qdev->h2c_qcnt--;
+		spin_unlock(&qdev->lock);
+
+		lock_descq(descq);
+		descq->enabled = 0;
+		unlock_descq(descq);
+		return rv;
+	}
 
 	return 0;
 }
@@ -438,7 +516,14 @@ int qdma_queue_add(unsigned long dev_hndl, struct qdma_queue_conf *qconf,
 	}
 
 	/* fill in config. info */
-	qdma_descq_config(descq, qconf, 0);
+	rv = qdma_descq_config(descq, qconf, 0, buf ? buf + len : NULL,
+				buflen - len);
+	if (rv < 0) {
+		lock_descq(descq);
+		descq->enabled = 0;
+		unlock_descq(descq);
+		goto err_out;
+	}
 
 	memcpy(qconf, &descq->conf, sizeof(*qconf));
 	*qhndl = (unsigned long)descq->conf.qidx;
@@ -547,13 +632,25 @@ int qdma_queue_stop(unsigned long dev_hndl, unsigned long id, char *buf,
 	qdma_descq_context_clear(descq->xdev, descq->qidx_hw, descq->conf.st,
 				descq->conf.c2h);
 
+	/*
+	 * the engine is stopped, the buffers of what is left can go. Once
+	 * offline no new request gets queued or written into the ring.
+	 */
+	lock_descq(descq);
+	descq->online = 0;
+	qdma_descq_cancel_all(descq);
+	unlock_descq(descq);
+
 	qdma_descq_free_resource(descq);
 
 	lock_descq(descq);
-	descq->online = 0;
 	descq->inited = 0;
 	unlock_descq(descq);
 
+	/* pollers see POLLERR, packet mode readers give up */
+	wake_up_interruptible(&descq->poll_wq);
+	wake_up_interruptible(&descq->rx_queue.pkt_wq);
+
 	if (buf && buflen) {
 		int len = sprintf(buf, "queue %s, idx %u stopped.\n",
 			descq->conf.name, descq->conf.qidx);
@@ -570,6 +667,7 @@ ssize_t qdma_sg_req_submit(unsigned long dev_hndl, unsigned long id,
 	struct qdma_sgt_req_cb *cb = qdma_req_cb_get(req);
 	struct sg_table *sgt = &req->sgt;
 	int wait = req->fp_done ? 0 : 1;
+	int wakeup;
 
 	if (!descq)
 		return -EINVAL;
@@ -584,6 +682,20 @@ ssize_t qdma_sg_req_submit(unsigned long dev_hndl, unsigned long id,
 	memset(cb, 0, QDMA_REQ_OPAQUE_SIZE);
 	init_waitqueue_head(&cb->wq);
 
+	if (req->ep_seg_nr) {
+		u64 len = 0;
+		unsigned int i;
+
+		for (i = 0; i < req->ep_seg_nr && req->ep_segs[i].len; i++)
+			len += req->ep_segs[i].len;
+		if (descq->conf.st || i < req->ep_seg_nr || len != req->count) {
+			pr_info("%s: bad card ranges, %u, %llu != %llu.\n",
+				descq->conf.name, req->ep_seg_nr, len,
+				req->count);
+			return -EINVAL;
+		}
+	}
+
 	if (descq->conf.st && descq->conf.c2h)
 		return qdma_sg_req_submit_st_c2h(xdev, descq, req);
 
@@ -604,14 +716,47 @@ ssize_t qdma_sg_req_submit(unsigned long dev_hndl, unsigned long id,
 		unlock_descq(descq);
 		pr_info("%s descq %s NOT online.\n",
 			xdev->conf.name, descq->conf.name);
+		if (!req->dma_mapped)
+			pci_unmap_sg(xdev->conf.pdev, sgt->sgl,
+					sgt->orig_nents,
+					descq->conf.c2h ? DMA_FROM_DEVICE :
+							DMA_TO_DEVICE);
 		return -EINVAL;
 	}
 	list_add_tail(&cb->list, &descq->work_list);
+
+	/*
+	 * inline submit: nothing queued ahead of us and the ring has room,
+	 * build the descriptors and ring the doorbell right here. Whatever
+	 * does not fit stays on the work_list for the kthread.
+	 */
+	if (descq->conf.inline_submit && descq->avail &&
+	    list_is_singular(&descq->work_list)) {
+		ssize_t rv = qdma_descq_proc_sgt_request(descq, cb);
+
+		qdma_descq_pidx_flush(descq);
+		if (rv < 0) {
+			list_del(&cb->list);
+			unlock_descq(descq);
+			pr_info("%s: cb 0x%p, inline submit failed %ld.\n",
+				descq->conf.name, cb, rv);
+			if (!req->dma_mapped)
+				pci_unmap_sg(xdev->conf.pdev, sgt->sgl,
+					sgt->orig_nents,
+					descq->conf.c2h ? DMA_FROM_DEVICE :
+							DMA_TO_DEVICE);
+			return rv;
+		}
+		descq->stat_inline_submit++;
+	}
+	/* cb may be completed & released as soon as the lock is dropped */
+	wakeup = cb->offset < req->count;
 	unlock_descq(descq);
 
 	pr_debug("%s: cb 0x%p submitted.\n", descq->conf.name, cb);
 
-	qdma_kthread_wakeup(descq->wrkthp);
+	if (wakeup)
+		qdma_kthread_wakeup(descq->wrkthp);
 
 	if (!wait)
 		return 0;
@@ -623,9 +768,10 @@ ssize_t qdma_sg_req_submit(unsigned long dev_hndl, unsigned long id,
 		wait_event_interruptible(cb->wq, cb->done);
 
 	if (!cb->done) {
-		/* timed out */
+		/* timed out, unless it completed since the wait gave up */
 		lock_descq(descq);
-		list_del(&cb->list);
+		if (!cb->done)
+			qdma_descq_cancel_request(descq, cb);
 		unlock_descq(descq);
 	}
 
@@ -636,7 +782,7 @@ ssize_t qdma_sg_req_submit(unsigned long dev_hndl, unsigned long id,
 	}
 
 	if (!cb->done || cb->status || !cb->offset) {
-		pr_info("%s: %c,%u,0x%llx, tm %u, off %u, err 0x%x, cmpl %d.\n",
+		pr_info("%s: %c,%llu,0x%llx, tm %u, off %llu, err 0x%x, cmpl %d.\n",
 			descq->conf.name, req->write ? 'W':'R', req->count,
 			req->ep_addr, req->timeout_ms, cb->offset, cb->status,
 			cb->done);
@@ -646,6 +792,198 @@ ssize_t qdma_sg_req_submit(unsigned long dev_hndl, unsigned long id,
 	return cb->offset;
 }
 
+int qdma_queue_bypass_submit(unsigned long dev_hndl, unsigned long id,
+			const void *desc, unsigned int desc_nr)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+	int rv;
+
+	if (!descq)
+		return -EINVAL;
+
+	if (!descq->conf.desc_bypass || (descq->conf.st && descq->conf.c2h)) {
+		pr_info("%s: NOT a mm/st h2c bypass queue.\n",
+			descq->conf.name);
+		return -EINVAL;
+	}
+
+	lock_descq(descq);
+	if (!descq->online) {
+		unlock_descq(descq);
+		pr_info("%s descq %s NOT online.\n",
+			xdev->conf.name, descq->conf.name);
+		return -EINVAL;
+	}
+	rv = qdma_descq_bypass_submit(descq, desc, desc_nr);
+	unlock_descq(descq);
+
+	return rv;
+}
+
+int qdma_queue_rx_ring_mmap(unsigned long dev_hndl, unsigned long id,
+			struct vm_area_struct *vma)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+
+	if (!descq)
+		return -EINVAL;
+
+	if (!descq->conf.st || !descq->conf.c2h) {
+		pr_info("%s: NOT a st c2h queue.\n", descq->conf.name);
+		return -EINVAL;
+	}
+
+	return qdma_descq_rx_ring_mmap(descq, vma);
+}
+
+int qdma_queue_rx_ring_kick(unsigned long dev_hndl, unsigned long id)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+
+	if (!descq)
+		return -EINVAL;
+
+	if (!descq->conf.st || !descq->conf.c2h) {
+		pr_info("%s: NOT a st c2h queue.\n", descq->conf.name);
+		return -EINVAL;
+	}
+
+	return qdma_descq_rx_ring_kick(descq);
+}
+
+int qdma_queue_recv_pkts(unsigned long dev_hndl, unsigned long id,
+			struct qdma_pkt_req *req)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+	struct st_rx_queue *rxq;
+	bool online;
+
+	if (!descq)
+		return -EINVAL;
+
+	if (!descq->conf.st || !descq->conf.c2h) {
+		pr_info("%s: NOT a st c2h queue.\n", descq->conf.name);
+		return -EINVAL;
+	}
+	rxq = &descq->rx_queue;
+
+	lock_descq(descq);
+	if (descq->rx_ring) {
+		unlock_descq(descq);
+		pr_info("%s: rx ring mmap'ed, NO read.\n", descq->conf.name);
+		return -EBUSY;
+	} else if (!descq->online) {
+		unlock_descq(descq);
+		pr_info("%s descq %s NOT online.\n",
+			xdev->conf.name, descq->conf.name);
+		return -EINVAL;
+	}
+	if (req->pkt_min)
+		descq->rx_pkt_waiters++;
+	unlock_descq(descq);
+
+	if (!req->pkt_min)
+		return qdma_descq_rxq_read_pkts(descq, req);
+
+	if (descq->wbthp)
+		qdma_kthread_wakeup(descq->wbthp);
+	else if (rxq->stalled)
+		qdma_descq_service_wb(descq);
+
+	if (descq->conf.busy_poll_us)
+		st_c2h_busy_poll(descq, st_c2h_pkts_ready, req);
+
+	/* a full rx queue will not hold any more packets */
+	if (req->timeout_ms)
+		wait_event_interruptible_timeout(rxq->pkt_wq,
+			st_c2h_pkts_ready(descq, req) || !descq->online,
+			msecs_to_jiffies(req->timeout_ms));
+	else
+		wait_event_interruptible(rxq->pkt_wq,
+			st_c2h_pkts_ready(descq, req) || !descq->online);
+
+	lock_descq(descq);
+	descq->rx_pkt_waiters--;
+	online = descq->online;
+	unlock_descq(descq);
+
+	if (!online) {
+		pr_info("%s descq %s stopped.\n",
+			xdev->conf.name, descq->conf.name);
+		return -EINVAL;
+	}
+
+	return qdma_descq_rxq_read_pkts(descq, req);
+}
+
+int qdma_queue_service(unsigned long dev_hndl, unsigned long id)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+
+	if (!descq)
+		return -EINVAL;
+
+	if (!descq->online)
+		return 0;
+
+	return qdma_descq_service_wb(descq);
+}
+
+unsigned int qdma_queue_poll(unsigned long dev_hndl, unsigned long id,
+			struct file *file, poll_table *wait)
+{
+	struct xlnx_dma_dev *xdev = (struct xlnx_dma_dev *)dev_hndl;
+	struct qdma_descq *descq = qdma_device_get_descq_by_id(xdev, id, NULL, 0, 1);
+	bool st_c2h;
+	unsigned int mask = 0;
+
+	if (!descq)
+		return POLLERR;
+
+	poll_wait(file, &descq->poll_wq, wait);
+
+	st_c2h = descq->conf.st && descq->conf.c2h;
+
+	lock_descq(descq);
+	if (!descq->online) {
+		unlock_descq(descq);
+		return POLLERR;
+	}
+	if (st_c2h) {
+		struct st_rx_ring *ring = descq->rx_ring;
+		struct st_rx_queue *rxq = &descq->rx_queue;
+
+		if (ring) {
+			if (ring->pidx != READ_ONCE(ring->hdr->cidx))
+				mask = POLLIN | POLLRDNORM;
+		} else {
+			spin_lock(&rxq->lock);
+			if (rxq->dlen || rxq->pkt_cnt)
+				mask = POLLIN | POLLRDNORM;
+			spin_unlock(&rxq->lock);
+		}
+	} else if (descq->avail) {
+		mask = descq->conf.c2h ? POLLIN | POLLRDNORM :
+					POLLOUT | POLLWRNORM;
+	}
+	unlock_descq(descq);
+
+	/* nothing yet: make sure the writebacks get looked at */
+	if (!mask && st_c2h) {
+		if (descq->wbthp)
+			qdma_kthread_wakeup(descq->wbthp);
+		else if (descq->rx_queue.stalled || descq->rx_ring)
+			qdma_descq_service_wb(descq);
+	}
+
+	return mask;
+}
+
 int libqdma_init(void)
 {
 	if (sizeof(struct qdma_sgt_req_cb) > QDMA_REQ_OPAQUE_SIZE) {
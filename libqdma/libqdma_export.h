@@ -16,6 +16,9 @@
 #include <linux/types.h>
 #include <linux/scatterlist.h>
 #include <linux/interrupt.h>
+#include <linux/poll.h>
+
+#include "qdma_ioctl.h"
 
 /* QDMA IP 2018.1 maximum */
 #define QDMA_MM_ENGINE_MAX	1	/* 2 with Everest */
@@ -47,7 +50,7 @@ struct qdma_dev_conf {
 	u8 c2h_channel_max;
 	u8 h2c_channel_max;
 	u8 poll_mode;
-	u8 pftch_en;
+	u8 pftch_en;		/* st c2h prefetch default for the queues */
 	u8 indirect_intr_mode;
 	u8 vf_max;		/* PF only: max. of vfs */
 	u32 qsets_max;		/* max. of queues */
@@ -121,6 +124,23 @@ struct qdma_queue_conf {
 	unsigned short qidx;	/* 0 ~ (qdma_dev_conf.qsets_max - 1) */
 	unsigned char st:1;
 	unsigned char c2h:1;
+	/* mm & st h2c: build descriptors in the caller's context when the
+	 * ring has room, the kthread only picks up what does not fit */
+	unsigned char inline_submit:1;
+	/* descriptors go out the descriptor bypass interface to the user
+	 * logic instead of straight to the dma engine */
+	unsigned char desc_bypass:1;
+	/* st c2h prefetch, with neither pftch_en nor pftch_dis set the
+	 * device's qdma_dev_conf.pftch_en applies */
+	unsigned char pftch_en:1;
+	unsigned char pftch_dis:1;
+	unsigned char pftch_bypass:1;
+	/* st c2h: move between the wrb moderation profiles with the rate of
+	 * packets received, overrides the three settings below */
+	unsigned char adaptive_coal:1;
+	/* st c2h: once rx_max_bytes/pkts is reached, drop the oldest packets
+	 * queued rather than stop taking new ones */
+	unsigned char rx_drop_oldest:1;
 #if 0
 	unsigned char poll:1;	/* polling or interrupt */
 	unsigned char c2h_fl:1;
@@ -129,6 +149,33 @@ struct qdma_queue_conf {
 #endif
 	unsigned char filler;
 	unsigned char st_c2h_wrb_desc_size;
+	/* ring size profile idx: 0 ~ (QDMA_RNG_SZ_PROFILE_CNT - 1) */
+	unsigned char rngsz_idx;	/* descriptor ring */
+	unsigned char wrb_rngsz_idx;	/* st c2h writeback ring */
+	/* st c2h buffer size idx: 0 ~ (QDMA_C2H_BUF_SZ_CNT - 1) */
+	unsigned char c2h_bufsz_idx;
+	/* st h2c: ring the pidx doorbell every N descriptors,
+	 * 0 - once per request. Any leftover is flushed at the end of each
+	 * submission pass */
+	unsigned short pidx_db_batch;
+	/* st h2c: max. bytes per descriptor, physically contiguous data is
+	 * gathered up to this length, 0 - PAGE_SIZE */
+	unsigned int st_h2c_desc_len_max;
+	/* st c2h: max. writeback entries per processing pass, what is left
+	 * goes to the next pass, 0 - ST_C2H_WB_BUDGET_DFLT */
+	unsigned short wb_budget;
+	/* st c2h: max. # of bytes/packets held for the reader, 0 - as many
+	 * as the ring takes */
+	unsigned int rx_max_bytes;
+	unsigned int rx_max_pkts;
+	/* st c2h wrb moderation: trigger mode (TRIG_MODE_XXX, 0 - any),
+	 * timer and counter threshold profile idx (0 ~ 15) */
+	unsigned char wrb_trig_mode;
+	unsigned char wrb_timer_idx;
+	unsigned char wrb_cnt_idx;
+	/* st c2h: a blocked reader polls the writebacks for up to this many
+	 * micro-seconds before going to sleep, 0 - no polling */
+	unsigned int busy_poll_us;
 
 	/* fill in by libqdma */
 	char name[QDMA_QUEUE_NAME_MAXLEN + 1];
@@ -168,6 +215,14 @@ int qdma_queue_dump_wrb(unsigned long dev_hndl, unsigned long qhndl,
 				unsigned int start, unsigned int end, char *buf,
 				int buflen);
 
+/*
+ * qdma_ep_seg - a range of the card's memory, see qdma_sg_req.ep_segs
+ */
+struct qdma_ep_seg {
+	u64 ep_addr;
+	u64 len;
+};
+
 /*
  * qdma_sg_req_submit - submit data for dma operation (for both read and write)
  * @hndl:
@@ -175,7 +230,7 @@ int qdma_queue_dump_wrb(unsigned long dev_hndl, unsigned long qhndl,
  *	 < 0 in case of error
  * TODO: exact error code will be defined later
  */
-#define QDMA_REQ_OPAQUE_SIZE 	64
+#define QDMA_REQ_OPAQUE_SIZE 	96
 struct qdma_sg_req {
 	/* private to the dma driver, do NOT touch */	
 	unsigned char opaque[QDMA_REQ_OPAQUE_SIZE];
@@ -185,17 +240,85 @@ struct qdma_sg_req {
 	bool dma_mapped;		/* if sgt is already dma mapped */
 	u64 ep_addr;			/* DDR/BRAM memory addr */
 	struct sg_table sgt;		/* scatter-gather list of data bufs */
-	unsigned int count;		/* total data size */
+	u64 count;			/* total data size */
 	unsigned int timeout_ms;	/* timeout in mili-seconds,
 					   0 - no timeout */
 	unsigned long priv_data;	/* for the calling function */
-	int (*fp_done)(struct qdma_sg_req *, unsigned int bytes_done, int err);
+	int (*fp_done)(struct qdma_sg_req *, u64 bytes_done, int err);
 					/* set fp_done for non-blocking mode */
+	/*
+	 * MM only, optional: instead of one range starting at ep_addr, the
+	 * data goes to/from ep_seg_nr card ranges in turn, their lengths
+	 * adding up to count. Still one request with one completion.
+	 */
+	struct qdma_ep_seg *ep_segs;
+	unsigned int ep_seg_nr;
 };
 
 ssize_t qdma_sg_req_submit(unsigned long dev_hndl, unsigned long qhndl,
 			struct qdma_sg_req *req);
 
+/*
+ * qdma_queue_bypass_submit - push caller built descriptors onto a
+ *	descriptor bypass queue (MM or ST H2C)
+ * @desc: desc_nr descriptors, each the size of the queue's descriptor
+ * return # of descriptors taken, less than desc_nr if the ring is short of
+ *	space, or < 0 in case of error
+ */
+int qdma_queue_bypass_submit(unsigned long dev_hndl, unsigned long qhndl,
+			const void *desc, unsigned int desc_nr);
+
+/*
+ * qdma_queue_recv_pkts - packet mode receive on a ST C2H queue, the packet
+ *	data is copied back to back into sgt and each packet described in
+ *	pkts, see QDMA_IOCTL_RECV_PKTS in qdma_ioctl.h
+ * return # of packets received or < 0 in case of error
+ */
+struct qdma_pkt_req {
+	struct sg_table sgt;		/* data buffer */
+	u64 count;			/* data buffer size */
+	struct qdma_pkt_desc *pkts;	/* pkt_max packet descriptors */
+	unsigned int pkt_max;
+	unsigned int pkt_min;		/* wait for that many, 0: no wait */
+	unsigned int timeout_ms;	/* 0: no timeout */
+	unsigned int pkt_cnt;		/* out: # of packets received */
+	u64 bytes;			/* out: # of bytes copied */
+};
+
+int qdma_queue_recv_pkts(unsigned long dev_hndl, unsigned long qhndl,
+			struct qdma_pkt_req *req);
+
+/*
+ * qdma_queue_rx_ring_mmap - map the receive ring of a ST C2H queue, see
+ *	qdma_ioctl.h for the layout. The queue delivers its data through
+ *	the ring only from then on, until it is stopped.
+ * qdma_queue_rx_ring_kick - pick up the ring entries handed back
+ * return 0 on success, < 0 in case of error
+ */
+struct vm_area_struct;
+int qdma_queue_rx_ring_mmap(unsigned long dev_hndl, unsigned long qhndl,
+			struct vm_area_struct *vma);
+int qdma_queue_rx_ring_kick(unsigned long dev_hndl, unsigned long qhndl);
+
+/*
+ * qdma_queue_service - process the writebacks of a queue in the caller's
+ *	context, completing any request that is done
+ * return > 0 if writebacks were left for another pass, 0 if none, or < 0 in
+ *	case of error
+ */
+int qdma_queue_service(unsigned long dev_hndl, unsigned long qhndl);
+
+/*
+ * qdma_queue_poll - readiness of a queue, for the poll method of a file
+ * @file, @wait: as passed to the poll method
+ * return POLLXXX mask: st c2h readable once data (or a zero length packet)
+ *	is queued or, with the rx ring mmap'ed, a ring entry is posted; mm and
+ *	st h2c readable (c2h) or writable (h2c) while the ring has free
+ *	descriptors; POLLERR if the queue is not online
+ */
+unsigned int qdma_queue_poll(unsigned long dev_hndl, unsigned long qhndl,
+			struct file *file, poll_table *wait);
+
 enum intr_ring_size_sel {
 	INTR_RING_SZ_4KB = 0,		/* 0 */
 	INTR_RING_SZ_8KB,		/* 1 */
@@ -16,6 +16,8 @@
 
 #include <linux/kernel.h>
 #include <linux/delay.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 #include "qdma_device.h"
 #include "qdma_intr.h"
@@ -52,6 +54,7 @@ static inline void descq_c2h_pidx_update_raw(struct qdma_descq *descq,
 
 static void descq_pidx_update(struct qdma_descq *descq, unsigned int pidx)
 {
+	descq->stat_pidx_db++;
 	pidx |= (descq->irq_en << S_WRB_PIDX_UPD_EN_INT);
 
 	if (descq->conf.c2h)
@@ -67,6 +70,7 @@ static inline void descq_wrb_cidx_update(struct qdma_descq *descq,
 	cidx |= (descq->wrb_stat_desc_en << S_WRB_CIDX_UPD_EN_STAT_DESC);
 	cidx |= V_WRB_CIDX_UPD_TRIG_MODE(descq->wrb_trig_mode);
 	cidx |= V_WRB_CIDX_UPD_TIMER_IDX(descq->wrb_timer_idx);
+	cidx |= V_WRB_CIDX_UPD_CNTER_IDX(descq->wrb_cnt_idx);
 
 	__write_reg(descq->xdev,
 		QDMA_REG_WRB_CIDX_BASE + descq->conf.qidx * QDMA_REG_PIDX_STEP,
@@ -89,6 +93,77 @@ static inline void intr_cidx_update(struct qdma_descq *descq,
 
 }
 
+/*
+ * rx page pool
+ */
+/* st c2h buffers are (compound) pages of st_c2h_pg_order */
+#define fl_pg_size(descq)	(PAGE_SIZE << (descq)->st_c2h_pg_order)
+
+static int pg_pool_alloc(struct qdma_descq *descq)
+{
+	struct st_rx_pg_pool *pool = &descq->pg_pool;
+	int node = dev_to_node(&descq->xdev->conf.pdev->dev);
+
+	pool->pg_list = kzalloc_node(descq->conf.rngsz * sizeof(struct fl_desc),
+				GFP_KERNEL, node);
+	if (!pool->pg_list) {
+		pr_info("%s OOM, pg pool %u.\n",
+			descq->conf.name, descq->conf.rngsz);
+		return -ENOMEM;
+	}
+	pool->max = descq->conf.rngsz;
+	pool->cnt = 0;
+	pool->stat_hit = 0ULL;
+	pool->stat_miss = 0ULL;
+
+	return 0;
+}
+
+static void pg_pool_free(struct qdma_descq *descq)
+{
+	struct st_rx_pg_pool *pool = &descq->pg_pool;
+	struct device *dev = &descq->xdev->conf.pdev->dev;
+
+	if (!pool->pg_list)
+		return;
+
+	spin_lock(&pool->lock);
+	while (pool->cnt) {
+		struct fl_desc *pg = pool->pg_list + --pool->cnt;
+
+		dma_unmap_page(dev, pg->dma_addr, fl_pg_size(descq),
+				DMA_FROM_DEVICE);
+		__free_pages(pg->pg, descq->st_c2h_pg_order);
+	}
+	spin_unlock(&pool->lock);
+
+	kfree(pool->pg_list);
+	pool->pg_list = NULL;
+	pool->max = 0;
+}
+
+/* the reader is done with a rx page: recycle it, or release if full */
+static void pg_pool_put(struct qdma_descq *descq, struct page *pg,
+			dma_addr_t dma_addr)
+{
+	struct st_rx_pg_pool *pool = &descq->pg_pool;
+
+	spin_lock(&pool->lock);
+	if (pool->cnt < pool->max) {
+		struct fl_desc *ent = pool->pg_list + pool->cnt++;
+
+		ent->pg = pg;
+		ent->dma_addr = dma_addr;
+		spin_unlock(&pool->lock);
+		return;
+	}
+	spin_unlock(&pool->lock);
+
+	dma_unmap_page(&descq->xdev->conf.pdev->dev, dma_addr,
+			fl_pg_size(descq), DMA_FROM_DEVICE);
+	__free_pages(pg, descq->st_c2h_pg_order);
+}
+
 /*
  * freelist
  */
@@ -106,8 +181,9 @@ static void fl_free(struct qdma_descq *descq)
 		if (!fl->pg)
 			break;
 		pr_debug("%s, fl %d, pg 0x%p.\n", descq->conf.name, i, fl->pg);
-		dma_unmap_page(dev, fl->dma_addr, PAGE_SIZE, DMA_FROM_DEVICE);
-		__free_pages(fl->pg, 0);
+		dma_unmap_page(dev, fl->dma_addr, fl_pg_size(descq),
+				DMA_FROM_DEVICE);
+		__free_pages(fl->pg, descq->st_c2h_pg_order);
 
 		fl->pg = NULL;
 		fl->dma_addr = 0UL;
@@ -117,27 +193,48 @@ static void fl_free(struct qdma_descq *descq)
 	descq->st_rx_fl = NULL;
 }
 
-static int fl_refill_entry(struct device *dev, struct fl_desc *fl)
+/*
+ * a page for a freelist slot, recycled or freshly allocated with gfp.
+ * fl is left untouched on failure.
+ */
+static int fl_get_page(struct qdma_descq *descq, struct fl_desc *fl,
+			gfp_t gfp)
 {
+	struct st_rx_pg_pool *pool = &descq->pg_pool;
+	struct device *dev = &descq->xdev->conf.pdev->dev;
 	int node = dev_to_node(dev);
+	bool pool_pg = false;
 	struct page *pg;
 	dma_addr_t mapping;
 
-	if (fl->pg) {
-		dma_unmap_page(dev, fl->dma_addr, PAGE_SIZE, DMA_FROM_DEVICE);
-		fl->pg = NULL;
-		fl->dma_addr = 0UL;
+	spin_lock(&pool->lock);
+	if (pool->cnt) {
+		struct fl_desc *ent = pool->pg_list + --pool->cnt;
+
+		pool->stat_hit++;
+		fl->pg = ent->pg;
+		fl->dma_addr = ent->dma_addr;
+		pool_pg = true;
+	} else
+		pool->stat_miss++;
+	spin_unlock(&pool->lock);
+
+	if (pool_pg) {
+		dma_sync_single_for_device(dev, fl->dma_addr,
+					descq->st_c2h_bufsz, DMA_FROM_DEVICE);
+		return 0;
 	}
 
-	pg = alloc_pages_node(node, GFP_KERNEL | __GFP_COMP, 0);
+	pg = alloc_pages_node(node, gfp | __GFP_COMP, descq->st_c2h_pg_order);
 	if (unlikely(!pg))
 		return -ENOMEM;
 
-	mapping = dma_map_page(dev, pg, 0, PAGE_SIZE, PCI_DMA_FROMDEVICE);
+	mapping = dma_map_page(dev, pg, 0, fl_pg_size(descq),
+				PCI_DMA_FROMDEVICE);
 	if (unlikely(dma_mapping_error(dev, mapping))) {
 		pr_info("page 0x%p mapping error 0x%llx.\n",
 			pg, (unsigned long long)mapping);
-		__free_pages(pg, 0);
+		__free_pages(pg, descq->st_c2h_pg_order);
 		return -ENOMEM;
 	}
 
@@ -166,13 +263,15 @@ static int fl_fill(struct qdma_descq *descq)
 	descq->st_rx_fl = fl;
 	for (i = 0; i < descq->conf.rngsz; i++, fl++) {
 		fl->pg = NULL;
-		rv = fl_refill_entry(&xdev->conf.pdev->dev, fl);
+		rv = fl_get_page(descq, fl, GFP_KERNEL);
 		if (rv < 0) {
 			pr_info("%s, %d, fl refill failed.\n",
 				descq->conf.name, i);
 			goto err_out;
 		}
 	}
+	/* only count the misses once the queue is running */
+	descq->pg_pool.stat_miss = 0ULL;
 
 	return 0;
 
@@ -181,246 +280,506 @@ err_out:
 	return -ENOMEM;
 }
 
-/* rxq helper functions: calling function should hold the lock */
-static inline struct st_rx_data *rxq_dequeue_head(struct st_rx_queue *rxq)
+/*
+ * rx queue
+ */
+static int rxq_alloc_resource(struct qdma_descq *descq)
 {
-	struct st_rx_data *rx = rxq->head;
+	struct st_rx_queue *rxq = &descq->rx_queue;
+	int node = dev_to_node(&descq->xdev->conf.pdev->dev);
+
+	rxq->data = kcalloc_node(descq->conf.rngsz, sizeof(struct st_rx_data),
+				GFP_KERNEL, node);
+	if (!rxq->data)
+		goto err_out;
 
-	if (rx) {
-		rxq->head = rx->next;
-		rx->next = NULL;
-		if (!rxq->head)
-		    rxq->tail = NULL;
-		rxq->dlen -= (rx->len - rx->offset);
+	if (descq->st_c2h_wrb_udd_en) {
+		rxq->udd = kcalloc_node(descq->conf.rngsz,
+					sizeof(struct st_rx_udd),
+					GFP_KERNEL, node);
+		if (!rxq->udd)
+			goto err_out;
 	}
 
-	return rx;
-}
+	rxq->size = descq->conf.rngsz;
+	rxq->dlen = 0;
+	rxq->cnt = 0;
+	rxq->pidx = 0;
+	rxq->cidx = 0;
+	rxq->pkt_cnt = 0;
+	rxq->stalled = false;
+	rxq->capped = false;
+	rxq->stat_stall = 0ULL;
+	rxq->stat_drop_pkts = 0ULL;
+	rxq->stat_drop_bytes = 0ULL;
+	return 0;
 
-static inline void rxq_enqueue_head(struct st_rx_queue *rxq,
-				struct st_rx_data *rx)
-{
-	rx->next = rxq->head;
-	rxq->head = rx;
-	if (!rxq->tail)
-		rxq->tail = rx;
-	rxq->dlen += rx->len - rx->offset;
+err_out:
+	pr_info("%s OOM, rxq %u.\n", descq->conf.name, descq->conf.rngsz);
+	kfree(rxq->data);
+	rxq->data = NULL;
+	return -ENOMEM;
 }
 
-static inline void rxq_enqueue_tail(struct st_rx_queue *rxq,
-				struct st_rx_data *rx)
+static void rxq_free_resource(struct qdma_descq *descq)
 {
-	rx->next = NULL;
-	if (!rxq->head)
-		rxq->head = rx;
-	else
-		rxq->tail->next = rx;
-	rxq->tail = rx;
-	rxq->dlen += rx->len - rx->offset;
-}
+	struct st_rx_queue *rxq = &descq->rx_queue;
+	struct device *dev = &descq->xdev->conf.pdev->dev;
 
-/* user def data helper functions: calling function should hold the lock */
-static inline struct st_c2h_wrb_udd *udd_dequeue_head(struct st_rx_queue *rxq)
-{
-    struct st_c2h_wrb_udd *udd = rxq->udd_head;
+	if (!rxq->data)
+		return;
 
-    if (udd) {
-	    rxq->udd_head = udd->next;
-	    udd->next = NULL;
-	    if (!rxq->udd_head)
-		    rxq->udd_tail = NULL;
-	    rxq->dlen -= (udd->udd_len - udd->offset);
-    }
+	spin_lock(&rxq->lock);
+	while (rxq->cnt) {
+		struct st_rx_data *rx = rxq->data + rxq->cidx;
 
-    return udd;
+		if (rx->pg) {
+			dma_unmap_page(dev, rx->dma_addr, fl_pg_size(descq),
+					DMA_FROM_DEVICE);
+			__free_pages(rx->pg, descq->st_c2h_pg_order);
+		}
+		if (++rxq->cidx == rxq->size)
+			rxq->cidx = 0;
+		rxq->cnt--;
+	}
+	rxq->dlen = 0;
+	rxq->size = 0;
+	rxq->pkt_cnt = 0;
+	spin_unlock(&rxq->lock);
+
+	kfree(rxq->udd);
+	rxq->udd = NULL;
+	kfree(rxq->data);
+	rxq->data = NULL;
 }
 
-static inline void udd_enqueue_head(struct st_rx_queue *rxq,
-                                             struct st_c2h_wrb_udd *udd)
+/* rx queue lock held: would a packet of n entries and len bytes fit? */
+static bool rxq_fits(struct qdma_descq *descq, unsigned int n,
+			unsigned int len)
 {
-    udd->next = rxq->udd_head;
-    rxq->udd_head = udd;
-    if (!rxq->udd_tail)
-	rxq->udd_tail = udd;
-    rxq->dlen += udd->udd_len - udd->offset;
+	struct st_rx_queue *rxq = &descq->rx_queue;
+
+	if (rxq->size - rxq->cnt < n)
+		return false;
+	/* an empty queue always takes a packet, however big */
+	if (!rxq->cnt)
+		return true;
+	if (descq->conf.rx_max_bytes &&
+	    rxq->dlen + len > descq->conf.rx_max_bytes)
+		return false;
+	if (descq->conf.rx_max_pkts && rxq->pkt_cnt >= descq->conf.rx_max_pkts)
+		return false;
+	return true;
 }
 
-static inline void udd_enqueue_tail(struct st_rx_queue *rxq,
-                                             struct st_c2h_wrb_udd *udd)
+/*
+ * rx queue lock held: drop the oldest packet, what is left of it. pkt_cnt
+ * goes with the eop entry as for the readers, but only a drop from the sop
+ * on is a dropped packet: the tail of one a reader already started on is
+ * not counted.
+ */
+static void rxq_drop_oldest(struct qdma_descq *descq)
 {
-    udd->next = NULL;
-    if (!rxq->udd_head)
-	rxq->udd_head = udd;
-    else
-	rxq->udd_tail->next = udd;
-    rxq->udd_tail = udd;
-    rxq->dlen += udd->udd_len - udd->offset;
+	struct st_rx_queue *rxq = &descq->rx_queue;
+	unsigned int len = 0;
+	bool sop = false;
+	bool eop = false;
+
+	if (rxq->cnt) {
+		struct st_rx_data *rx = rxq->data + rxq->cidx;
+		struct st_rx_udd *udd = rxq->udd ? rxq->udd + rxq->cidx : NULL;
+
+		sop = (rx->flags & ST_RX_F_SOP) && !rx->offset &&
+			(!udd || !udd->offset);
+	}
+
+	while (!eop && rxq->cnt) {
+		struct st_rx_data *rx = rxq->data + rxq->cidx;
+		struct st_rx_udd *udd = rxq->udd ? rxq->udd + rxq->cidx : NULL;
+
+		len += rx->len - rx->offset;
+		if (udd)
+			len += udd->len - udd->offset;
+
+		eop = rx->flags & ST_RX_F_EOP;
+		if (rx->pg)
+			pg_pool_put(descq, rx->pg, rx->dma_addr);
+		rx->pg = NULL;
+		if (++rxq->cidx == rxq->size)
+			rxq->cidx = 0;
+		rxq->cnt--;
+	}
+	rxq->dlen -= len;
+	if (eop)
+		rxq->pkt_cnt--;
+	if (eop && sop) {
+		rxq->stat_drop_pkts++;
+		rxq->stat_drop_bytes += len;
+	}
 }
 
-static inline void rxq_free_resource(struct st_rx_queue *rxq)
+/*
+ * wrb processing: room for a packet of n entries and len bytes? If not, the
+ * oldest packets make way for it with rx_drop_oldest, otherwise the queue
+ * stalls: the wrb is left alone and the freelist not refilled, so the hw
+ * backs off until the reader catches up.
+ */
+static bool rxq_has_room(struct qdma_descq *descq, unsigned int n,
+			unsigned int len)
 {
-    struct st_rx_data *rx = rxq_dequeue_head(rxq);
+	struct st_rx_queue *rxq = &descq->rx_queue;
+	bool room;
+
+	spin_lock(&rxq->lock);
+	room = rxq_fits(descq, n, len);
+	rxq->capped = !room && descq->conf.rx_drop_oldest;
+	while (!room && descq->conf.rx_drop_oldest && rxq->pkt_cnt) {
+		rxq_drop_oldest(descq);
+		room = rxq_fits(descq, n, len);
+	}
+	if (!room && !rxq->stalled)
+		rxq->stat_stall++;
+	rxq->stalled = !room;
+	spin_unlock(&rxq->lock);
 
-    while (rx) {
-	    __free_pages(rx->pg, 0);
-	    kfree(rx);
-	    rx = rxq_dequeue_head(rxq);
-    }
+	return room;
 }
 
+/*
+ * fl_nr freelist pages of a packet, or a udd only packet if fl_nr is 0.
+ * flags: ST_RX_F_XXX, sop (and err) go to the first entry, eop to the last
+ */
 static int descq_st_c2h_rx_data(unsigned long arg, struct fl_desc *fl,
-				int fl_nr, struct st_c2h_wrb_udd *udd_ref)
+				int fl_nr, unsigned int flags,
+				const unsigned char *udd, unsigned int udd_len)
 {
 	struct qdma_descq *descq = (struct qdma_descq *)arg;
 	struct st_rx_queue *rxq = &descq->rx_queue;
-	struct st_rx_data *rx = kmalloc(sizeof(*rx), GFP_KERNEL);
+	int n = fl_nr ? fl_nr : 1;
+	int i;
 
-	if (!rx) {
-		pr_err("%s, OOM.\n", descq->conf.name);
-		return -ENOMEM;
+	spin_lock(&rxq->lock);
+	if (unlikely(rxq->size - rxq->cnt < n)) {
+		spin_unlock(&rxq->lock);
+		return -ENOSPC;
 	}
 
-	do {
-		rx->pg = fl->pg;
-		rx->offset = 0;
-		rx->len = fl->len;
-		rx->udd_ref = udd_ref;
+	for (i = 0; i < n; i++) {
+		struct st_rx_data *rx = rxq->data + rxq->pidx;
 
-		spin_lock(&rxq->lock);
-		rxq_enqueue_tail(rxq, rx);
-		spin_unlock(&rxq->lock);
+		if (rxq->udd) {
+			struct st_rx_udd *slot = rxq->udd + rxq->pidx;
 
-		fl_nr--;
-	} while (fl_nr);
+			/* only the first entry carries the udd */
+			slot->len = (!i && udd) ? udd_len : 0;
+			slot->offset = 0;
+			if (slot->len)
+				memcpy(slot->data, udd, udd_len);
+			rxq->dlen += slot->len;
+		}
+
+		if (fl_nr) {
+			rx->pg = fl[i].pg;
+			rx->dma_addr = fl[i].dma_addr;
+			rx->len = fl[i].len;
+		} else {
+			rx->pg = NULL;
+			rx->len = 0;
+		}
+		rx->offset = 0;
+		rx->flags = 0;
+		if (!i)
+			rx->flags |= flags & (ST_RX_F_SOP | ST_RX_F_ERR);
+		if (i == n - 1 && (flags & ST_RX_F_EOP)) {
+			rx->flags |= ST_RX_F_EOP;
+			rxq->pkt_cnt++;
+		}
+		rxq->dlen += rx->len;
+
+		if (++rxq->pidx == rxq->size)
+			rxq->pidx = 0;
+		rxq->cnt++;
+	}
+	spin_unlock(&rxq->lock);
 
 	return 0;
 }
 
+/*
+ * st c2h receive ring
+ */
+static void rx_ring_free(struct st_rx_ring *ring)
+{
+	vfree(ring->hdr);
+	kfree(ring);
+}
+
+/* hand the freelist entries of the ring entries the app is done with
+ * back to the hw */
+static void rx_ring_reclaim(struct qdma_descq *descq)
+{
+	struct st_rx_ring *ring = descq->rx_ring;
+	struct device *dev = &descq->xdev->conf.pdev->dev;
+	unsigned int cidx = READ_ONCE(ring->hdr->cidx);
+	unsigned int buf_cidx = ring->buf_cidx;
+	unsigned int posted;
+	unsigned int n;
+
+	if (unlikely(cidx >= ring->ring_sz))
+		return;
+
+	posted = (ring->pidx + ring->ring_sz - ring->cidx) % ring->ring_sz;
+	n = (cidx + ring->ring_sz - ring->cidx) % ring->ring_sz;
+	if (!n || n > posted)
+		return;
+
+	while (n--) {
+		unsigned int i;
+
+		for (i = ring->buf_cnt[ring->cidx]; i; i--) {
+			struct fl_desc *fl = descq->st_rx_fl + buf_cidx;
+
+			dma_sync_single_for_device(dev, fl->dma_addr,
+					descq->st_c2h_bufsz, DMA_FROM_DEVICE);
+			if (++buf_cidx >= descq->conf.rngsz)
+				buf_cidx = 0;
+		}
+		if (++ring->cidx >= ring->ring_sz)
+			ring->cidx = 0;
+	}
+
+	if (buf_cidx != ring->buf_cidx) {
+		ring->buf_cidx = buf_cidx;
+		descq_pidx_update(descq, buf_cidx ? buf_cidx - 1 :
+						descq->conf.rngsz - 1);
+	}
+}
+
+/*
+ * post the packet of a wrb entry, the freelist entries it used stay with
+ * the app until given back via hdr->cidx. An errored entry is posted
+ * flagged, so that its buffers go back the same way.
+ * return the next freelist index or -ENOSPC if the ring is full
+ */
+static int rx_ring_post(struct qdma_descq *descq, __be64 *wrb,
+			unsigned int pidx)
+{
+	struct st_rx_ring *ring = descq->rx_ring;
+	struct device *dev = &descq->xdev->conf.pdev->dev;
+	struct qdma_rx_ring_ent *ent = ring->ent + ring->pidx;
+	unsigned int next = ring->pidx + 1;
+	u32 len = (wrb[0] >> S_C2H_WB_ENTRY_LENGTH) & M_C2H_WB_ENTRY_LENGTH;
+	unsigned int fl_nr = DIV_ROUND_UP(len, descq->st_c2h_bufsz);
+
+	if (next >= ring->ring_sz)
+		next = 0;
+	if (next == ring->cidx) {
+		ring->stat_full++;
+		return -ENOSPC;
+	}
+
+	ent->flags = 0;
+	if (unlikely((wrb[0] >> S_C2H_WB_ENTRY_F_DESC_ERR) & 0x1)) {
+		pr_warn_ratelimited("%s, wb entry error.\n", descq->conf.name);
+		ent->flags = QDMA_RX_RING_F_ERR;
+	}
+
+	ent->buf_idx = pidx;
+	ent->len = len;
+	ent->buf_cnt = fl_nr;
+	ent->udd_len = 0;
+	if (descq->st_c2h_wrb_udd_en) {
+		unsigned char *udd_ptr = (unsigned char *)wrb;
+
+		ent->udd_len = min_t(unsigned int, QDMA_C2H_UDD_MAX,
+				descq->st_c2h_wrb_entry_len -
+				L_C2H_WB_ENTRY_DMA_INFO + 1);
+		ent->udd[0] = udd_ptr[L_C2H_WB_ENTRY_DMA_INFO - 1] & 0xF0;
+		memcpy(&ent->udd[1], &udd_ptr[L_C2H_WB_ENTRY_DMA_INFO],
+			ent->udd_len - 1);
+	}
+	ring->buf_cnt[ring->pidx] = fl_nr;
+	ring->pidx = next;
+	ring->stat_pkts++;
+
+	for (; fl_nr; fl_nr--) {
+		struct fl_desc *fl = descq->st_rx_fl + pidx;
+		unsigned int l = min_t(unsigned int, len, descq->st_c2h_bufsz);
+
+		dma_sync_single_for_cpu(dev, fl->dma_addr, l, DMA_FROM_DEVICE);
+		len -= l;
+		if (++pidx >= descq->conf.rngsz)
+			pidx = 0;
+	}
+
+	return pidx;
+}
+
 /*
  * dma transfer requests
  */
+
+/* a blocking submitter unmaps the sgl itself, a non-blocking one can not */
+static inline void req_unmap(struct qdma_descq *descq,
+				struct qdma_sgt_req_cb *cb)
+{
+	struct qdma_sg_req *req = (struct qdma_sg_req *)cb;
+
+	if (!req->fp_done || req->dma_mapped ||
+	    (descq->conf.st && descq->conf.c2h))
+		return;
+
+	pci_unmap_sg(descq->xdev->conf.pdev, req->sgt.sgl, req->sgt.orig_nents,
+		descq->conf.c2h ? DMA_FROM_DEVICE : DMA_TO_DEVICE);
+}
+
 static inline void req_submitted(struct qdma_descq *descq,
 				struct qdma_sgt_req_cb *cb)
 {
+	unsigned int last = (descq->pidx ? descq->pidx :
+					descq->conf.rngsz) - 1;
+
+	/* the request retires once hw consumes its last descriptor */
+	descq->req_slot[last] = cb;
+
 	list_del(&cb->list);
 	list_add_tail(&cb->list, &descq->pend_list);
 }
 
-static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
-				struct qdma_sgt_req_cb *cb)
+/*
+ * mm request, the direction is a compile time constant so each of the
+ * h2c/c2h wrappers below gets its own branch-free fill loop
+ */
+static __always_inline ssize_t descq_mm_proc_request(struct qdma_descq *descq,
+				struct qdma_sgt_req_cb *cb, const bool c2h)
 {
 	struct qdma_sg_req *req = (struct qdma_sg_req *)cb;
 	struct sg_table *sgt = &req->sgt;
 	struct scatterlist *sg = sgt->sgl;
 	unsigned int sg_offset = 0;
 	unsigned int sg_max = sgt->nents;
-	u64 ep_addr = req->ep_addr;
+	u64 ep_addr = req->ep_addr + cb->offset;
+	u64 ep_left = ~0ULL;		/* in the current card range */
+	unsigned int seg = 0;
 	struct qdma_mm_desc *desc = (struct qdma_mm_desc *)descq->desc;
-	struct qdma_mm_desc *desc_start = NULL;
-	struct qdma_mm_desc *desc_end = NULL;
 	unsigned int desc_max = descq->avail;
-	unsigned int data_cnt = 0;
+	u64 data_cnt = 0;
 	unsigned int desc_cnt = 0;
-	unsigned int len = 0;
-	int i = 0;
+	unsigned int i = 0;
 
 	if (!desc_max) {
 		pr_info("descq %s, full, try again.\n", descq->conf.name);
 		return 0;
 	}
 
-	if (cb->offset) {
-		int rv;
-		rv = sgt_find_offset(sgt, cb->offset, &sg, &sg_offset);
-		if (rv < 0 || rv >= sg_max) {
-			pr_info("descq %s, req 0x%p, OOR %u/%u, %d/%u.\n",
-				descq->conf.name, req, cb->offset, req->count,
-				rv, sg_max);
+	/* multiple card ranges: find the one the next byte goes to/from */
+	if (req->ep_seg_nr) {
+		u64 off = cb->offset;
+
+		while (seg < req->ep_seg_nr && off >= req->ep_segs[seg].len)
+			off -= req->ep_segs[seg++].len;
+		if (seg == req->ep_seg_nr)
 			return -EINVAL;
-		}
-		i = rv;
-		pr_info("%s, req 0x%p, offset %u/%u -> sg %d, 0x%p,%u.\n",
-			descq->conf.name, req, cb->offset, req->count, rv, sg,
+		ep_addr = req->ep_segs[seg].ep_addr + off;
+		ep_left = req->ep_segs[seg].len - off;
+	}
+
+	/* resume where the previous pass stopped */
+	if (cb->sg) {
+		sg = cb->sg;
+		i = cb->sg_idx;
+		sg_offset = cb->sg_offset;
+		pr_debug("%s, req 0x%p, offset %llu/%llu -> sg %u, 0x%p,%u.\n",
+			descq->conf.name, req, cb->offset, req->count, i, sg,
 			sg_offset);
-	} else
-		i = 0;
+	}
 
 	desc += descq->pidx;
-	desc_start = desc;
 
-	for (; i < sg_max && desc_cnt < desc_max; i++, sg = sg_next(sg)) {
-		unsigned int tlen = sg_dma_len(sg);
-		dma_addr_t addr = sg_dma_address(sg);
-
-		pr_debug("sgl %d, len %u,%u, offset %u.\n",
-			i, len, tlen, sg_offset);
+	/*
+	 * physically contiguous data, within and across sg entries (e.g., the
+	 * pages of a huge page or an iommu mapping), is gathered up to
+	 * XDMA_DESC_BLEN_MAX per descriptor. A descriptor never crosses into
+	 * the next card range.
+	 */
+	while (sg && i < sg_max && ep_left && desc_cnt < desc_max) {
+		dma_addr_t addr = sg_dma_address(sg) + sg_offset;
+		unsigned int len_max = min_t(u64, XDMA_DESC_BLEN_MAX, ep_left);
+		unsigned int len = 0;
+		struct qdma_mm_desc d;
+
+		do {
+			unsigned int tlen = min_t(unsigned int,
+					sg_dma_len(sg) - sg_offset,
+					len_max - len);
+
+			len += tlen;
+			sg_offset += tlen;
+			if (sg_offset == sg_dma_len(sg)) {
+				sg_offset = 0;
+				sg = (++i < sg_max) ? sg_next(sg) : NULL;
+			}
+		} while (sg && len < len_max &&
+			 (sg_dma_address(sg) + sg_offset) == (addr + len));
 
-		if (sg_offset) {
-			sg_offset = 0;
-			tlen -= sg_offset;
-			addr += sg_offset;
-		}
+		pr_debug("sgl %u, len %u, offset %u.\n", i, len, sg_offset);
 
-		while (tlen) {
-			unsigned int len = min_t(unsigned int, tlen,
-						XDMA_DESC_BLEN_MAX);
-			desc_end = desc;
+		d.src_addr = c2h ? ep_addr : addr;
+		d.dst_addr = c2h ? addr : ep_addr;
+		d.flag_len = len | (1 << S_DESC_F_DV);
+		d.rsvd0 = 0U;
+		d.rsvd1 = 0UL;
 
-			desc->rsvd1 = 0UL;
-			desc->rsvd0 = 0U;
+		ep_addr += len;
+		ep_left -= len;
+		data_cnt += len;
 
-			if (descq->conf.c2h) {
-				desc->src_addr = ep_addr;
-				desc->dst_addr = addr;
-			} else {
-				desc->dst_addr = ep_addr;
-				desc->src_addr = addr;
-			}
+		if (!ep_left && ++seg < req->ep_seg_nr) {
+			ep_addr = req->ep_segs[seg].ep_addr;
+			ep_left = req->ep_segs[seg].len;
+		}
 
-			desc->flag_len = len;
-			desc->flag_len |= (1 << S_DESC_F_DV);
+		/* sop/eop bracket the descriptors of this pass */
+		if (!desc_cnt)
+			d.flag_len |= (1 << S_DESC_F_SOP);
+		if (!sg || !ep_left || (desc_cnt + 1) == desc_max)
+			d.flag_len |= (1 << S_DESC_F_EOP);
 
-			ep_addr += len;
-			data_cnt += len;
-			addr += len;
-			tlen -= len;
+		/* the whole 32B descriptor in one go */
+		*desc = d;
 
-			if (++descq->pidx == descq->conf.rngsz) {
-				descq->pidx = 0;
-				desc = (struct qdma_mm_desc *)descq->desc;
-			} else {
-				desc++;
-			}
-
-			desc_cnt++;
-			if (desc_cnt == desc_max)
-				break;
+		if (++descq->pidx == descq->conf.rngsz) {
+			descq->pidx = 0;
+			desc = (struct qdma_mm_desc *)descq->desc;
+		} else {
+			desc++;
 		}
+
+		desc_cnt++;
 	}
 
-	if (!desc_end || !desc_start) {
-		pr_info("descq %s, %u, pidx 0x%x, desc 0x%p ~ 0x%p.\n",
-			descq->conf.name, descq->qidx_hw, descq->pidx,
-			desc_start, desc_end);
+	if (!desc_cnt) {
+		pr_info("descq %s, %u, pidx 0x%x, req 0x%p, nothing to submit.\n",
+			descq->conf.name, descq->qidx_hw, descq->pidx, req);
 		return -EIO;
 	}
 
-	/* set eop */
-	desc_end->flag_len |= (1 << S_DESC_F_EOP);
-	/* set sop */
-	desc_start->flag_len |= (1 << S_DESC_F_SOP);
-
 	descq->avail -= desc_cnt;
-	cb->desc_nr += desc_cnt;
 	cb->offset += data_cnt;
+	cb->sg = sg;
+	cb->sg_idx = i;
+	cb->sg_offset = sg_offset;
 
-	pr_debug("descq %s, +%u,%u, avail %u, ep_addr 0x%llx + 0x%x(%u).\n",
+	pr_debug("descq %s, +%u,%u, avail %u, ep_addr 0x%llx + 0x%llx(%llu).\n",
 		descq->conf.name, desc_cnt, descq->pidx, descq->avail,
 		req->ep_addr, data_cnt, data_cnt);
 
+	descq->stat_bytes += data_cnt;
+
 	if (cb->offset == req->count)
 		req_submitted(descq, cb);
 
+	descq->pidx_db_pend = 0;
 	descq_pidx_update(descq, descq->pidx);
 
 	if (descq->wbthp)
@@ -429,6 +788,18 @@ static ssize_t descq_mm_proc_request(struct qdma_descq *descq,
 	return 0;
 }
 
+static ssize_t descq_mm_h2c_proc_request(struct qdma_descq *descq,
+				struct qdma_sgt_req_cb *cb)
+{
+	return descq_mm_proc_request(descq, cb, false);
+}
+
+static ssize_t descq_mm_c2h_proc_request(struct qdma_descq *descq,
+				struct qdma_sgt_req_cb *cb)
+{
+	return descq_mm_proc_request(descq, cb, true);
+}
+
 static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 				struct qdma_sgt_req_cb *cb)
 {
@@ -439,9 +810,9 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 	unsigned int sg_max = sgt->nents;
 	struct qdma_h2c_desc *desc = (struct qdma_h2c_desc *)descq->desc;
 	unsigned int desc_max = descq->avail;
-	unsigned int data_cnt = 0;
+	u64 data_cnt = 0;
 	unsigned int desc_cnt = 0;
-	int i = 0;
+	unsigned int i = 0;
 
 	/* calling function should hold the lock */
 
@@ -451,81 +822,87 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 	}
 
 #if 0
-	pr_info("%s, req %u.\n", descq->conf.name, req->count);
+	pr_info("%s, req %llu.\n", descq->conf.name, req->count);
 	sgt_dump(sgt);
 #endif
 
-	if (cb->offset) {
-		int rv;
-		rv = sgt_find_offset(sgt, cb->offset, &sg, &sg_offset);
-		if (rv < 0 || rv >= sg_max) {
-			pr_info("descq %s, req 0x%p, OOR %u/%u, %d/%u.\n",
-				descq->conf.name, req, cb->offset, req->count,
-				rv, sg_max);
-			return -EINVAL;
-		}
-		i = rv;
-		pr_info("%s, req 0x%p, offset %u/%u -> sg %d, 0x%p,%u.\n",
-			descq->conf.name, req, cb->offset, req->count, rv, sg,
+	/* resume where the previous pass stopped */
+	if (cb->sg) {
+		sg = cb->sg;
+		i = cb->sg_idx;
+		sg_offset = cb->sg_offset;
+		pr_debug("%s, req 0x%p, offset %llu/%llu -> sg %u, 0x%p,%u.\n",
+			descq->conf.name, req, cb->offset, req->count, i, sg,
 			sg_offset);
-	} else
-		i = 0;
+	}
 
 	desc += descq->pidx;
 
-	for (; i < sg_max && desc_cnt < desc_max; i++, sg = sg_next(sg)) {
-		unsigned int tlen = sg_dma_len(sg);
-		dma_addr_t addr = sg_dma_address(sg);
-
-		if (sg_offset) {
-			sg_offset = 0;
-			tlen -= sg_offset;
-			addr += sg_offset;
-		}
-
-		while (tlen) {
-			unsigned int len = min_t(unsigned int, tlen, PAGE_SIZE);
-
-			desc->src_addr = addr;
-
-			desc->flag_len = len;
-			desc->flag_len |= (1 << S_DESC_F_DV) |
-					  (1 << S_DESC_F_SOP) |
-					  (1 << S_DESC_F_EOP);
+	/*
+	 * one request is one packet: sop on its very first descriptor, eop on
+	 * the one that completes it. Physically contiguous data, within and
+	 * across sg entries, is gathered up to desc_len_max per descriptor.
+	 */
+	while (sg && i < sg_max && desc_cnt < desc_max) {
+		dma_addr_t addr = sg_dma_address(sg) + sg_offset;
+		unsigned int len = 0;
+
+		do {
+			unsigned int tlen = min_t(unsigned int,
+					sg_dma_len(sg) - sg_offset,
+					descq->conf.st_h2c_desc_len_max - len);
+
+			len += tlen;
+			sg_offset += tlen;
+			if (sg_offset == sg_dma_len(sg)) {
+				sg_offset = 0;
+				sg = (++i < sg_max) ? sg_next(sg) : NULL;
+			}
+		} while (sg && len < descq->conf.st_h2c_desc_len_max &&
+			 (sg_dma_address(sg) + sg_offset) == (addr + len));
 
-			data_cnt += len;
-			addr += len;
-			tlen -= len;
+		desc->src_addr = addr;
+		desc->flag_len = len | (1 << S_DESC_F_DV);
+		if (!cb->offset && !data_cnt)
+			desc->flag_len |= (1 << S_DESC_F_SOP);
+		data_cnt += len;
+		if ((cb->offset + data_cnt) == req->count)
+			desc->flag_len |= (1 << S_DESC_F_EOP);
 
 #if 0
-			pr_info("desc %d, pidx 0x%x:\n", i, descq->pidx);
-			print_hex_dump(KERN_INFO, "desc", DUMP_PREFIX_OFFSET,
-					 16, 1, (void *)desc, 16, false);
+		pr_info("desc %d, pidx 0x%x:\n", i, descq->pidx);
+		print_hex_dump(KERN_INFO, "desc", DUMP_PREFIX_OFFSET,
+				 16, 1, (void *)desc, 16, false);
 #endif
 
-			if (++descq->pidx == descq->conf.rngsz) {
-				descq->pidx = 0;
-				desc = (struct qdma_h2c_desc *)descq->desc;
-			} else {
-				desc++;
-			}
+		if (++descq->pidx == descq->conf.rngsz) {
+			descq->pidx = 0;
+			desc = (struct qdma_h2c_desc *)descq->desc;
+		} else {
+			desc++;
+		}
 
-			descq_pidx_update(descq, descq->pidx);
+		if (++descq->pidx_db_pend == descq->conf.pidx_db_batch)
+			qdma_descq_pidx_flush(descq);
 
-			desc_cnt++;
-			if (desc_cnt == desc_max)
-				break;
-		}
+		desc_cnt++;
 	}
 
 	descq->avail -= desc_cnt;
-	cb->desc_nr += desc_cnt;
 	cb->offset += data_cnt;
+	cb->sg = sg;
+	cb->sg_idx = i;
+	cb->sg_offset = sg_offset;
+	descq->stat_bytes += data_cnt;
 
-	pr_debug("descq %s, +%u,%u, avail %u, 0x%x(%u).\n",
+	pr_debug("descq %s, +%u,%u, avail %u, 0x%llx(%llu).\n",
 		descq->conf.name, desc_cnt, descq->pidx, descq->avail, data_cnt,
 		data_cnt);
 
+	/* batch of 0: one doorbell per request */
+	if (!descq->conf.pidx_db_batch)
+		qdma_descq_pidx_flush(descq);
+
 	if (cb->offset == req->count)
 		req_submitted(descq, cb);
 
@@ -535,40 +912,6 @@ static ssize_t descq_proc_st_h2c_request(struct qdma_descq *descq,
 	return 0;
 }
 
-static void req_update_pend(struct qdma_descq *descq, unsigned int credit)
-{
-	struct qdma_sgt_req_cb *cb, *tmp;
-
-	pr_debug("%s, 0x%p, credit %u + %u.\n",
-		descq->conf.name, descq, credit, descq->credit);
-
-	credit += descq->credit;
-
-	/* calling routine should hold the lock */
-	list_for_each_entry_safe(cb, tmp, &descq->pend_list, list) {
-		pr_debug("%s, 0x%p, cb 0x%p, desc_nr %u, credit %u.\n",
-			descq->conf.name, descq, cb, cb->desc_nr, credit);
-		if (credit >= cb->desc_nr) {
-			pr_debug("%s, cb 0x%p done, credit %u > %u.\n",
-				descq->conf.name, cb, credit, cb->desc_nr);
-			credit -= cb->desc_nr;
-			qdma_sgt_req_done(cb, 0);
-		} else {
-			pr_debug("%s, cb 0x%p not done, credit %u < %u.\n",
-				descq->conf.name, cb, credit, cb->desc_nr);
-			cb->desc_nr -= credit;
-			credit = 0;
-		}
-
-		if (!credit)
-			break;
-	}
-
-	descq->credit = credit;
-	pr_debug("%s, 0x%p, credit %u.\n",
-		descq->conf.name, descq, descq->credit);
-}
-
 /*
  * descriptor Queue
  */
@@ -663,30 +1006,32 @@ static void desc_alloc_irq(struct qdma_descq *descq)
 /*
  * writeback handling
  */
-static inline int descq_wb_credit(struct qdma_descq *q, unsigned int cidx)
+static void descq_req_retire(struct qdma_descq *descq, unsigned int cidx_hw)
 {
-	unsigned int n;
-
-	if (cidx == q->cidx)
-		return 0;
+	unsigned int cidx = descq->cidx;
 
-	/* wrapped around */
-	n = (cidx < q->cidx) ? (q->conf.rngsz - q->cidx) + cidx :
-				cidx - q->cidx;
-
-	pr_info("descq %s, cidx 0x%x -> 0x%x, avail 0x%x + 0x%x.\n",
-		q->conf.name, q->cidx, cidx, q->avail, n);
-
-	q->cidx = cidx;
-	q->avail += n;
+	/* calling routine should hold the lock */
+	while (cidx != cidx_hw) {
+		struct qdma_sgt_req_cb *cb = descq->req_slot[cidx];
+
+		if (cb) {
+			pr_debug("%s, cb 0x%p done, slot 0x%x.\n",
+				descq->conf.name, cb, cidx);
+			descq->req_slot[cidx] = NULL;
+			req_unmap(descq, cb);
+			qdma_sgt_req_done(cb, 0);
+		}
 
-	return n;
+		descq->avail++;
+		if (++cidx == descq->conf.rngsz)
+			cidx = 0;
+	}
+	descq->cidx = cidx;
 }
 
 static int descq_mm_n_h2c_wb(struct qdma_descq *descq)
 {
 	unsigned int cidx, cidx_hw;
-	unsigned int cr;
 	struct qdma_desc_wb *wb;
 	struct xlnx_dma_dev *xdev = descq->xdev;
 
@@ -715,7 +1060,18 @@ static int descq_mm_n_h2c_wb(struct qdma_descq *descq)
 		descq->conf.name, wb->rsvd, wb->cidx, cidx, wb->pidx);
 #endif
 
-	cr = descq_wb_credit(descq, cidx_hw);
+	if (unlikely(cidx_hw >= descq->conf.rngsz)) {
+		pr_info("descq %s, bad wb cidx 0x%x, ring %u.\n",
+			descq->conf.name, cidx_hw, descq->conf.rngsz);
+		return -EIO;
+	}
+
+	/* retire the requests whose last descriptor hw has consumed */
+	descq_req_retire(descq, cidx_hw);
+
+	/* ring space freed up */
+	if (waitqueue_active(&descq->poll_wq))
+		wake_up_interruptible(&descq->poll_wq);
 
 	/* Worker thread may have only setup a fraction of the transfer (e.g.
 	 * there wasn't enough space in desc ring). We now have more space
@@ -725,8 +1081,7 @@ static int descq_mm_n_h2c_wb(struct qdma_descq *descq)
 	if (!list_empty(&descq->work_list) && descq->avail)
 		qdma_kthread_wakeup(descq->wrkthp);
 
-	req_update_pend(descq, cr);
-
+	descq->pidx_db_pend = 0;
 	descq_pidx_update(descq, descq->pidx);
 
 	if(xdev->intr_coal_en)		{
@@ -758,33 +1113,130 @@ static inline void wrb_next(struct qdma_descq *descq)
 	}
 }
 
+static unsigned int rxq_copy(struct qdma_descq *descq, struct sg_table *sgt,
+			unsigned int count, bool *stalled);
+
+/*
+ * st c2h read done, calling routine holds the lock: a blocking reader copies
+ * the data itself once woken up, a non-blocking one (fp_done) gets it here.
+ */
+static void rx_request_done(struct qdma_descq *descq,
+			struct qdma_sgt_req_cb *cb)
+{
+	struct qdma_sg_req *req = (struct qdma_sg_req *)cb;
+	unsigned int copied;
+	bool stalled;
+
+	if (!req->fp_done) {
+		qdma_sgt_req_done(cb, 0);
+		return;
+	}
+
+	copied = rxq_copy(descq, &req->sgt, req->count, &stalled);
+	list_del(&cb->list);
+	cb->offset = copied;
+	cb->status = 0;
+	cb->done = 1;
+	req->fp_done(req, copied, 0);
+
+	/* room freed up on a stalled queue: have the wrb processing resume */
+	if (stalled) {
+		descq->wb_more = true;
+		if (!descq->wbthp)
+			schedule_work(&descq->work);
+	}
+}
+
 static void inline check_rx_request_completed(struct qdma_descq *descq)
 {
 	struct st_rx_queue *rxq = &descq->rx_queue;
 	struct qdma_sgt_req_cb *cb, *tmp;
-	unsigned int dlen;
+	bool full;
+	u64 dlen;
 
 	spin_lock(&rxq->lock);
 	dlen = rxq->dlen;
+	full = rxq->stalled || rxq->capped;
 	spin_unlock(&rxq->lock);
 
 	pr_debug("%s, 0x%p, rx data %u.\n", descq->conf.name, descq, rxq->dlen);
 
 	list_for_each_entry_safe(cb, tmp, &descq->pend_list, list) {
-		pr_debug("%s, 0x%p, cb 0x%p, left %u.\n",
+		pr_debug("%s, 0x%p, cb 0x%p, left %llu.\n",
 			descq->conf.name, descq, cb, cb->offset);
 
 		if (dlen < cb->offset) {
-			pr_debug("%s, cb 0x%p pending, left %u > %u.\n",
+			/* the rx queue is full, take what is there */
+			if (full && dlen) {
+				rx_request_done(descq, cb);
+				break;
+			}
+			pr_debug("%s, cb 0x%p pending, left %llu > %llu.\n",
 				descq->conf.name, cb, cb->offset, dlen);
 			break;
 		}
 
-		pr_debug("%s, cb 0x%p done, left %u <= %u.\n",
+		pr_debug("%s, cb 0x%p done, left %llu <= %llu.\n",
 			descq->conf.name, cb, cb->offset, dlen);
 
 		dlen -= cb->offset;
-		qdma_sgt_req_done(cb, 0);
+		rx_request_done(descq, cb);
+	}
+
+	if (waitqueue_active(&rxq->pkt_wq))
+		wake_up_interruptible(&rxq->pkt_wq);
+	if (waitqueue_active(&descq->poll_wq))
+		wake_up_interruptible(&descq->poll_wq);
+}
+
+/*
+ * adaptive wrb moderation: once per COAL_ADAPT_INTERVAL, step the timer and
+ * counter threshold profile up if the packet rate seen would take more than
+ * COAL_ADAPT_IRQ_RATE interrupts a second, and back down once the profile
+ * below coalesces twice what is needed. The timer and counter profile
+ * tables are index paired (see qdma_regs.c), so one index moves both.
+ * coal_ts only moves with wrb processing: a gap over COAL_ADAPT_IDLE is
+ * taken as idle and steps down. The new profile goes out with the next
+ * wrb cidx update.
+ */
+#define COAL_ADAPT_INTERVAL	(HZ / 10)
+#define COAL_ADAPT_IDLE		(4 * COAL_ADAPT_INTERVAL)
+#define COAL_ADAPT_IRQ_RATE	20000
+
+static void descq_wrb_coal_adapt(struct qdma_descq *descq, unsigned int cnt)
+{
+	unsigned long elapsed = jiffies - descq->coal_ts;
+	unsigned int idx = descq->wrb_cnt_idx;
+	u64 want;
+
+	BUILD_BUG_ON(QDMA_C2H_TIMER_CNT_CNT != QDMA_C2H_CNT_TH_CNT);
+
+	descq->coal_pkts += cnt;
+	if (elapsed < COAL_ADAPT_INTERVAL)
+		return;
+
+	if (elapsed > COAL_ADAPT_IDLE) {
+		if (idx)
+			idx--;
+	} else {
+		/* wrb entries per interrupt to stay within the interrupt rate */
+		want = div_u64(descq->coal_pkts, jiffies_to_msecs(elapsed) *
+					(COAL_ADAPT_IRQ_RATE / 1000));
+
+		if (qdma_c2h_cnt_th_profile[idx] < want &&
+		    idx < QDMA_C2H_CNT_TH_CNT - 1)
+			idx++;
+		else if (idx && qdma_c2h_cnt_th_profile[idx - 1] >= 2 * want)
+			idx--;
+	}
+
+	descq->coal_pkts = 0;
+	descq->coal_ts = jiffies;
+
+	if (idx != descq->wrb_cnt_idx) {
+		descq->wrb_cnt_idx = idx;
+		descq->wrb_timer_idx = idx;
+		descq->stat_coal_change++;
 	}
 }
 
@@ -795,9 +1247,13 @@ static int descq_st_c2h_wb(struct qdma_descq *descq)
 				descq->desc_wrb_wb;
 	unsigned int pidx = descq->pidx;
 	struct xlnx_dma_dev *xdev = descq->xdev;
+	struct st_rx_ring *ring = descq->rx_ring;
 	int budget;
 	int proc_cnt;
 
+	if (ring)
+		rx_ring_reclaim(descq);
+
 	qdma_rmb();
 
 	descq->pidx_wrb = wb->pidx;
@@ -806,10 +1262,17 @@ static int descq_st_c2h_wb(struct qdma_descq *descq)
 		budget = descq->pidx_wrb - descq->cidx_wrb;
 	else if (descq->pidx_wrb < descq->cidx_wrb)
 		budget = descq->pidx_wrb +
-			(descq->conf.rngsz - descq->cidx_wrb);
+			(descq->rngsz_wrb - descq->cidx_wrb);
 	else
 		budget = 0;
 
+	/* leave the rest to the next pass, so others get their turn */
+	descq->wb_more = budget > descq->conf.wb_budget;
+	if (descq->wb_more) {
+		budget = descq->conf.wb_budget;
+		descq->stat_wb_resched++;
+	}
+
 	proc_cnt = budget;
 
 	while (likely(budget)) {
@@ -817,65 +1280,119 @@ static int descq_st_c2h_wb(struct qdma_descq *descq)
 		u32 err;
 		int fl_nr;
 		__be64 *wrb;
-		struct st_rx_queue *rxq = &descq->rx_queue;
-		struct st_c2h_wrb_udd *udd = NULL;
+		unsigned char udd[ST_C2H_UDD_MAX];
+		unsigned int udd_len = 0;
+		unsigned int flags = ST_RX_F_SOP;
+		bool drop = false;
 
 		qdma_rmb();
 
 		wrb = descq->desc_wrb_cur;
 
-		if (descq->st_c2h_wrb_udd_en) {
-			unsigned char *udd_ptr = NULL;
+		if (ring) {
+			int rv = rx_ring_post(descq, wrb, pidx);
 
-			udd = kmalloc(sizeof(struct st_c2h_wrb_udd), GFP_KERNEL);
-			if (!udd) {
-				pr_err("%s, OOM.\n", descq->conf.name);
-				return -ENOMEM;
-			}
-			udd->udd_len = descq->st_c2h_wrb_entry_len -
-				L_C2H_WB_ENTRY_DMA_INFO + 1; /* +1 for extra nibble*/
-			udd->data = kmalloc(udd->udd_len, GFP_KERNEL);
-			if (!udd->data) {
-				pr_err("%s, OOM.\n", descq->conf.name);
-				return -ENOMEM;
+			if (rv < 0) {
+				/* ring full */
+				descq->wb_more = false;
+				break;
 			}
-			udd_ptr = (unsigned char *)&wrb[0];
-			udd->data[0] = udd_ptr[L_C2H_WB_ENTRY_DMA_INFO - 1] & 0xF0;
-			memcpy(&udd->data[1],
-			       &udd_ptr[L_C2H_WB_ENTRY_DMA_INFO],
-			       udd->udd_len - 1);
-			udd->offset = 0;
-			udd_enqueue_tail(rxq, udd);
+			pidx = rv;
+
+			wrb_next(descq);
+			budget--;
+			continue;
 		}
+
 		len = (wrb[0] >> S_C2H_WB_ENTRY_LENGTH) &
 			M_C2H_WB_ENTRY_LENGTH;
 		err = (wrb[0] >> S_C2H_WB_ENTRY_F_DESC_ERR) & 0x1;
 		if (unlikely(err)) {
+			/* pass it on flagged, the packet mode reader sees it */
 			pr_warn_ratelimited("%s, wb entry error: 0x%x",
 					descq->conf.name, err);
-			return -EIO;
+			flags |= ST_RX_F_ERR;
 		}
 
-		fl_nr = (len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		fl_nr = DIV_ROUND_UP(len, descq->st_c2h_bufsz);
+		/* rx queue full: leave the wrb, the freelist is not refilled
+		 * and the hw backs off until the reader catches up */
+		if (unlikely(!rxq_has_room(descq, fl_nr ? fl_nr : 1, len))) {
+			descq->wb_more = false;
+			break;
+		}
+
+		if (descq->st_c2h_wrb_udd_en) {
+			unsigned char *udd_ptr = (unsigned char *)&wrb[0];
+
+			udd_len = descq->st_c2h_wrb_entry_len -
+				L_C2H_WB_ENTRY_DMA_INFO + 1; /* +1 for extra nibble*/
+			udd[0] = udd_ptr[L_C2H_WB_ENTRY_DMA_INFO - 1] & 0xF0;
+			memcpy(&udd[1], &udd_ptr[L_C2H_WB_ENTRY_DMA_INFO],
+				udd_len - 1);
+
+		}
+
+		if (!fl_nr)
+			descq->fp_rx_handler(descq->arg, NULL, 0,
+					flags | ST_RX_F_EOP,
+					udd_len ? udd : NULL, udd_len);
+
 		while (fl_nr) {
 			struct fl_desc *fl = descq->st_rx_fl;
 			struct qdma_c2h_desc *desc = (struct qdma_c2h_desc *)
 						descq->desc;
+			struct fl_desc new;
 			int rv;
 
 			desc += pidx;
 			fl += pidx;
-			fl->len = min_t(unsigned int, len, PAGE_SIZE);
-
-			descq->fp_rx_handler(descq->arg, fl, 1, udd);
-			udd = NULL;
+			fl->len = min_t(unsigned int, len, descq->st_c2h_bufsz);
 
-			rv = fl_refill_entry(dev, fl);
-			if (rv < 0) {
-				pr_warn_ratelimited("%s, refill fl %d, failed %d.\n",
-					descq->conf.name, pidx, rv);
+			/*
+			 * the page only goes to the rx queue once there is
+			 * one to put in its place, we hold the lock: no sleep
+			 */
+			if (drop || fl_get_page(descq, &new,
+					GFP_ATOMIC | __GFP_NOWARN) < 0) {
+				if (!drop) {
+					pr_warn_ratelimited("%s, refill fl %d failed, pkt dropped.\n",
+						descq->conf.name, pidx);
+					/* close what was passed on of it */
+					if (!(flags & ST_RX_F_SOP))
+						descq->fp_rx_handler(descq->arg,
+							NULL, 0, ST_RX_F_EOP |
+							ST_RX_F_ERR, NULL, 0);
+					spin_lock(&descq->rx_queue.lock);
+					descq->rx_queue.stat_drop_pkts++;
+					spin_unlock(&descq->rx_queue.lock);
+					drop = true;
+				}
+				rv = -ENOMEM;
+			} else {
+				dma_sync_single_for_cpu(dev, fl->dma_addr,
+						fl->len, DMA_FROM_DEVICE);
+				if (fl_nr == 1)
+					flags |= ST_RX_F_EOP;
+				rv = descq->fp_rx_handler(descq->arg, fl, 1,
+						flags, udd_len ? udd : NULL,
+						udd_len);
+				udd_len = 0;
+				flags = 0;
+				if (rv < 0)
+					pg_pool_put(descq, new.pg,
+							new.dma_addr);
+				else {
+					fl->pg = new.pg;
+					fl->dma_addr = new.dma_addr;
+				}
 			}
 
+			if (rv < 0)
+				/* data dropped, the page goes straight back */
+				dma_sync_single_for_device(dev, fl->dma_addr,
+					descq->st_c2h_bufsz, DMA_FROM_DEVICE);
+
 			desc->dst_addr = fl->dma_addr;
 
 			fl_nr--;
@@ -888,6 +1405,7 @@ static int descq_st_c2h_wb(struct qdma_descq *descq)
 		wrb_next(descq);
 		budget--;
 	}
+	proc_cnt -= budget;
 
 	if (proc_cnt) {
 		pr_info("%s, 0x%x proc'ed, pidx_wrb 0x%x cidx_wrb 0x%x, pidx 0x%x.\n",
@@ -895,8 +1413,15 @@ static int descq_st_c2h_wb(struct qdma_descq *descq)
 			descq->cidx_wrb, pidx);
 
 		descq->pidx = pidx;
-		descq_pidx_update(descq, descq->pidx ? descq->pidx - 1 :
-							descq->conf.rngsz - 1);
+		if (ring) {
+			/* entries visible before the new pidx */
+			smp_wmb();
+			WRITE_ONCE(ring->hdr->pidx, ring->pidx);
+		} else
+			descq_pidx_update(descq, descq->pidx ?
+					descq->pidx - 1 : descq->conf.rngsz - 1);
+		if (descq->conf.adaptive_coal)
+			descq_wrb_coal_adapt(descq, proc_cnt);
 		descq_wrb_cidx_update(descq, descq->cidx_wrb);
 		if(xdev->intr_coal_en)		{
 			if(xdev->intr_coal_list->cidx >= xdev->intr_coal_list->intr_ring_size) {
@@ -912,9 +1437,13 @@ static int descq_st_c2h_wb(struct qdma_descq *descq)
 			}
 			intr_cidx_update(descq, xdev->intr_coal_list->cidx);
 		}
-		check_rx_request_completed(descq);
 	}
 
+	/* a reader may be waiting on a queue that stopped growing */
+	if (proc_cnt || !list_empty(&descq->pend_list) ||
+	    descq->rx_pkt_waiters)
+		check_rx_request_completed(descq);
+
 	return 0;
 }
 
@@ -940,6 +1469,9 @@ void qdma_descq_init(struct qdma_descq *descq, struct xlnx_dma_dev *xdev,
 	descq->conf.qidx = idx_sw;
 
 	spin_lock_init(&descq->rx_queue.lock);
+	init_waitqueue_head(&descq->rx_queue.pkt_wq);
+	init_waitqueue_head(&descq->poll_wq);
+	spin_lock_init(&descq->pg_pool.lock);
 }
 
 void qdma_descq_cleanup(struct qdma_descq *descq)
@@ -965,6 +1497,16 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 	struct xlnx_dma_dev *xdev = descq->xdev;
 	int rv;
 
+	/* request processing, picked once per queue type */
+	if (!descq->conf.st)
+		descq->fp_proc_request = descq->conf.c2h ?
+					descq_mm_c2h_proc_request :
+					descq_mm_h2c_proc_request;
+	else if (!descq->conf.c2h)
+		descq->fp_proc_request = descq_proc_st_h2c_request;
+	else	/* st c2h is served from the rx queue */
+		descq->fp_proc_request = NULL;
+
 	/* descriptor ring */
 	descq->desc = desc_ring_alloc(xdev, descq->conf.rngsz,
 				get_desc_size(descq), get_desc_wb_size(descq),
@@ -975,12 +1517,34 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 		goto err_out;
 	}
 
+	if (!descq->conf.st || !descq->conf.c2h) {
+		/* request completion cookies, one per descriptor slot */
+		descq->req_slot = kzalloc_node(descq->conf.rngsz *
+					sizeof(struct qdma_sgt_req_cb *),
+					GFP_KERNEL,
+					dev_to_node(&xdev->conf.pdev->dev));
+		if (!descq->req_slot) {
+			pr_info("dev %s, descq %s, sz %u, req slot OOM.\n",
+				xdev->conf.name, descq->conf.name,
+				descq->conf.rngsz);
+			goto err_out;
+		}
+	}
+
 	if (descq->conf.st && descq->conf.c2h) {
 		int i;
 		struct qdma_c2h_desc *desc = (struct qdma_c2h_desc *)
 						descq->desc;
 		struct fl_desc *fl;
 
+		rv = rxq_alloc_resource(descq);
+		if (rv < 0)
+			goto err_out;
+
+		rv = pg_pool_alloc(descq);
+		if (rv < 0)
+			goto err_out;
+
 		rv = fl_fill(descq);
 		if (rv < 0)
 			goto err_out;
@@ -1004,7 +1568,6 @@ int qdma_descq_alloc_resource(struct qdma_descq *descq)
 		descq->desc_wrb_cur = descq->desc_wrb;
 		descq->fp_rx_handler = descq_st_c2h_rx_data;
 		descq->arg = (unsigned long)descq;
-		descq->rx_queue.dlen = 0;
 	}
 
 	pr_info("%s: %u/%u, rng %u,%u, desc 0x%p, fl 0x%p, wb 0x%p.\n",
@@ -1042,6 +1605,16 @@ void qdma_descq_free_resource(struct qdma_descq *descq)
 		descq->desc_bus = 0UL;
 	}
 
+	if (descq->req_slot) {
+		kfree(descq->req_slot);
+		descq->req_slot = NULL;
+	}
+
+	if (descq->rx_ring) {
+		rx_ring_free(descq->rx_ring);
+		descq->rx_ring = NULL;
+	}
+
 	if (descq->st_rx_fl)
 		fl_free(descq);
 
@@ -1056,149 +1629,460 @@ void qdma_descq_free_resource(struct qdma_descq *descq)
 		descq->desc_wrb_bus = 0UL;
 	}
 
-	if (descq->rx_queue.dlen) {
-		struct st_rx_queue *rxq = &descq->rx_queue;
+	rxq_free_resource(descq);
 
-		spin_lock(&rxq->lock);
-		rxq_free_resource(rxq);
-		spin_unlock(&rxq->lock);
-	}
+	pg_pool_free(descq);
 }
 
-int qdma_descq_rxq_read(struct qdma_descq *descq, struct sg_table *sgt,
-                unsigned int count)
+/* copy up to count bytes from the rx queue into sgt, *stalled: if the rx
+ * queue was stalled */
+static unsigned int rxq_copy(struct qdma_descq *descq, struct sg_table *sgt,
+			unsigned int count, bool *stalled)
 {
-	struct scatterlist *sgl = sgt->sgl;
-	struct scatterlist *sg;
 	struct st_rx_queue *rxq = &descq->rx_queue;
-	struct st_rx_data *rx;
+	struct scatterlist *sg = sgt->sgl;
 	unsigned int sg_max = sgt->nents;
+	unsigned int sg_off = 0;
 	unsigned int copied = 0;
 	int i = 0;
-	struct st_c2h_wrb_udd *udd = NULL;
 
 	spin_lock(&rxq->lock);
+	while (rxq->cnt && i < sg_max && copied < count) {
+		struct st_rx_data *rx = rxq->data + rxq->cidx;
+		struct st_rx_udd *udd = rxq->udd ? rxq->udd + rxq->cidx : NULL;
+		unsigned int copy = min_t(unsigned int, sg->length - sg_off,
+					count - copied);
+
+		/* the udd of a packet goes ahead of its data */
+		if (udd && udd->offset < udd->len) {
+			copy = min_t(unsigned int, copy,
+					udd->len - udd->offset);
+			memcpy(sg_virt(sg) + sg_off, udd->data + udd->offset,
+				copy);
+			udd->offset += copy;
+		} else {
+			copy = min_t(unsigned int, copy, rx->len - rx->offset);
+			if (copy)
+				memcpy(sg_virt(sg) + sg_off,
+					page_address(rx->pg) + rx->offset,
+					copy);
+			rx->offset += copy;
+		}
+		copied += copy;
+		rxq->dlen -= copy;
+
+		sg_off += copy;
+		if (sg_off == sg->length) {
+			sg = sg_next(sg);
+			sg_off = 0;
+			i++;
+		}
 
-	rx = rxq_dequeue_head(rxq);
-	if ((rx == NULL) && descq->st_c2h_wrb_udd_en) {
-		/* This is the case where there is no actual data */
-		udd = udd_dequeue_head(rxq);
-		if (udd == NULL) {
-			pr_err("Write back entry without udd or actual data\n");
-			return copied;
+		if (rx->offset == rx->len && (!udd || udd->offset == udd->len)) {
+			if (rx->pg)
+				pg_pool_put(descq, rx->pg, rx->dma_addr);
+			rx->pg = NULL;
+			if (rx->flags & ST_RX_F_EOP)
+				rxq->pkt_cnt--;
+			if (++rxq->cidx == rxq->size)
+				rxq->cidx = 0;
+			rxq->cnt--;
 		}
 	}
-	for_each_sg(sgl, sg, sg_max, i) {
-		unsigned int len = sg->length;
-		unsigned int off = 0;
-		unsigned int udd_state = 0;
+	*stalled = rxq->stalled;
+	spin_unlock(&rxq->lock);
 
-		while (len && (rx || udd)) {
-			unsigned int copy = len;
-			/*
-			 * These are the cases to consider corresponding to write back entries:
-			 * 1. There is actual data and user defined data.
-			 * 2. There is only actual data. No user defined data
-			 * 3. There is only user defined data
-			 * */
-			/* rx->offset=0 indicates transmission of SOP */
-			if ((rx && (rx->udd_ref != NULL) &&
-				(rx->offset == 0)) || udd) {
-				unsigned int udd_cpy;
-
-				udd_state = 1;
-				if (rx) {
-					udd = udd_dequeue_head(rxq);
-					udd_state = 2;
-				}
-				if (udd) {
-					udd_state = 3;
-					udd_cpy = min_t(unsigned int,
-					                copy,
-					                udd->udd_len -
-					                udd->offset);
-
-					memcpy(sg_virt(sg) + off,
-					       udd->data + rx->offset, udd_cpy);
-					len -= udd_cpy;
-					off += udd_cpy;
-					copied += udd_cpy;
-					udd->offset += udd_cpy;
-
-					if (udd->offset == udd->udd_len) {
-						/* free already dequeued udd */
-						kfree(udd->data);
-						kfree(udd);
-						if (rx) {
-							udd = NULL;
-						} else {
-							/* when no actual data, it is continous udd */
-							udd = udd_dequeue_head(rxq);
-						}
-					} else
-					    udd_enqueue_head(rxq, udd);
-					/* No actual data can be copied, so rx has to be enqueued back.
-					 *                          * so not returning here */
-					pr_info("\ncopied udd at off=%d\n\n",copied-udd_cpy);
-				}
-			}
+	return copied;
+}
 
-			if (rx) {
-				copy = min_t(unsigned int, len,
-				             rx->len - rx->offset);
+int qdma_descq_rxq_read(struct qdma_descq *descq, struct sg_table *sgt,
+                unsigned int count)
+{
+	bool stalled;
+	unsigned int copied = rxq_copy(descq, sgt, count, &stalled);
 
-				memcpy(sg_virt(sg) + off,
-				       page_address(rx->pg) + rx->offset, copy);
-			}
+	/* the wrb processing backed off on a full queue, resume it */
+	if (stalled)
+		qdma_descq_service_wb(descq);
 
-			copied += copy;
-			len -= copy;
-			off += copy;
-			rx->offset += copy;
+	return copied;
+}
 
-			if (rx->offset == rx->len) {
-				__free_pages(rx->pg, 0);
-				kfree(rx);
-				rx = rxq_dequeue_head(rxq);
+/* copy up to len bytes into the sg list at *sgp + *sg_off */
+static unsigned int rxq_copy_to_sg(struct scatterlist **sgp,
+				unsigned int *sg_off, const void *src,
+				unsigned int len)
+{
+	struct scatterlist *sg = *sgp;
+	unsigned int copied = 0;
+
+	while (sg && copied < len) {
+		unsigned int copy = min_t(unsigned int, sg->length - *sg_off,
+					len - copied);
+
+		memcpy(sg_virt(sg) + *sg_off, src + copied, copy);
+		copied += copy;
+		*sg_off += copy;
+		if (*sg_off == sg->length) {
+			sg = sg_next(sg);
+			*sg_off = 0;
+		}
+	}
+	*sgp = sg;
+
+	return copied;
+}
+
+int qdma_descq_rxq_read_pkts(struct qdma_descq *descq,
+				struct qdma_pkt_req *req)
+{
+	struct st_rx_queue *rxq = &descq->rx_queue;
+	struct scatterlist *sg = req->sgt.sgl;
+	unsigned int sg_off = 0;
+	bool stalled;
+
+	req->pkt_cnt = 0;
+	req->bytes = 0;
+
+	spin_lock(&rxq->lock);
+	while (rxq->pkt_cnt && req->pkt_cnt < req->pkt_max &&
+		req->bytes < req->count) {
+		struct qdma_pkt_desc *pkt = req->pkts + req->pkt_cnt;
+		bool eop = false;
+
+		pkt->offset = req->bytes;
+		pkt->len = 0;
+		pkt->flags = 0;
+		pkt->udd_len = 0;
+
+		/* an eop entry is queued, so this ends within the queue */
+		while (!eop) {
+			struct st_rx_data *rx = rxq->data + rxq->cidx;
+			struct st_rx_udd *udd = rxq->udd ?
+						rxq->udd + rxq->cidx : NULL;
+			unsigned int len = rx->len - rx->offset;
+			unsigned int copy;
+
+			if (udd && udd->offset < udd->len) {
+				copy = min_t(unsigned int,
+					udd->len - udd->offset,
+					QDMA_C2H_UDD_MAX - pkt->udd_len);
+				memcpy(pkt->udd + pkt->udd_len,
+					udd->data + udd->offset, copy);
+				pkt->udd_len += copy;
+				rxq->dlen -= udd->len - udd->offset;
+				udd->offset = udd->len;
 			}
+			if (rx->flags & ST_RX_F_ERR)
+				pkt->flags |= QDMA_PKT_F_ERR;
+
+			copy = min_t(u64, len, req->count - req->bytes);
+			if (copy)
+				copy = rxq_copy_to_sg(&sg, &sg_off,
+					page_address(rx->pg) + rx->offset,
+					copy);
+			if (copy < len)
+				pkt->flags |= QDMA_PKT_F_TRUNC;
+			pkt->len += copy;
+			req->bytes += copy;
+			rxq->dlen -= len;
+
+			eop = rx->flags & ST_RX_F_EOP;
+			if (rx->pg)
+				pg_pool_put(descq, rx->pg, rx->dma_addr);
+			rx->pg = NULL;
+			rx->offset = rx->len;
+			if (++rxq->cidx == rxq->size)
+				rxq->cidx = 0;
+			rxq->cnt--;
+		}
+		rxq->pkt_cnt--;
+		req->pkt_cnt++;
+
+		/* the buffer is used up */
+		if (pkt->flags & QDMA_PKT_F_TRUNC)
+			break;
+	}
+	stalled = rxq->stalled;
+	spin_unlock(&rxq->lock);
+
+	if (stalled)
+		qdma_descq_service_wb(descq);
+
+	return req->pkt_cnt;
+}
+
+/*
+ * switch an online st c2h queue over to the receive ring, mapping the ring
+ * and the freelist pages into vma. Once switched, the queue stays so until
+ * it is stopped.
+ */
+int qdma_descq_rx_ring_mmap(struct qdma_descq *descq,
+				struct vm_area_struct *vma)
+{
+	unsigned int ring_sz = descq->conf.rngsz;
+	unsigned int len = QDMA_RX_RING_LEN(ring_sz, PAGE_SIZE);
+	unsigned long map_len = QDMA_RX_RING_MMAP_LEN(ring_sz, PAGE_SIZE,
+						fl_pg_size(descq));
+	unsigned long addr = vma->vm_start;
+	struct st_rx_ring *ring;
+	struct qdma_rx_ring_hdr *hdr;
+	struct page **pages;
+	unsigned int i;
+	int rv = 0;
+
+	if (vma->vm_end - vma->vm_start != map_len) {
+		pr_info("%s, mmap len %lu, expect %lu.\n",
+			descq->conf.name, vma->vm_end - vma->vm_start,
+			map_len);
+		return -EINVAL;
+	}
+
+	pages = kcalloc(ring_sz, sizeof(struct page *), GFP_KERNEL);
+	ring = kzalloc(sizeof(struct st_rx_ring) + ring_sz * sizeof(u16),
+			GFP_KERNEL);
+	if (!pages || !ring) {
+		pr_info("%s OOM, rx ring %u.\n", descq->conf.name, ring_sz);
+		rv = -ENOMEM;
+		goto free_pages;
+	}
+
+	hdr = vmalloc_user(len);
+	if (!hdr) {
+		pr_info("%s OOM, rx ring len %u.\n", descq->conf.name, len);
+		rv = -ENOMEM;
+		goto free_pages;
+	}
+	ring->hdr = hdr;
+	ring->ent = (struct qdma_rx_ring_ent *)(hdr + 1);
+	ring->len = len;
+	ring->ring_sz = ring_sz;
+	ring->buf_cnt = (u16 *)(ring + 1);
+
+	hdr->ring_sz = ring_sz;
+	hdr->ent_offset = sizeof(struct qdma_rx_ring_hdr);
+	hdr->ent_size = sizeof(struct qdma_rx_ring_ent);
+	hdr->buf_cnt = ring_sz;
+	hdr->buf_size = descq->st_c2h_bufsz;
+	hdr->buf_stride = fl_pg_size(descq);
+	hdr->buf_offset = len;
+
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	for (i = 0; i < len; i += PAGE_SIZE) {
+		rv = vm_insert_page(vma, addr + i,
+				vmalloc_to_page((u8 *)hdr + i));
+		if (rv < 0) {
+			pr_info("%s, rx ring insert page %u failed %d.\n",
+				descq->conf.name, i >> PAGE_SHIFT, rv);
+			goto free_ring;
 		}
+	}
+	addr += len;
 
-		if (!rx && !udd)
-		    break;
+	lock_descq(descq);
+	if (!descq->online || descq->rx_ring || descq->rx_queue.cnt ||
+	    !list_empty(&descq->pend_list)) {
+		unlock_descq(descq);
+		pr_info("%s busy, online %d, ring 0x%p, rxq %u.\n",
+			descq->conf.name, descq->online, descq->rx_ring,
+			descq->rx_queue.cnt);
+		rv = -EBUSY;
+		goto free_ring;
+	}
+	for (i = 0; i < ring_sz; i++) {
+		if (!descq->st_rx_fl[i].pg)
+			break;
+		pages[i] = descq->st_rx_fl[i].pg;
+	}
+	if (i < ring_sz) {
+		unlock_descq(descq);
+		pr_info("%s, fl %u NO page.\n", descq->conf.name, i);
+		rv = -ENOMEM;
+		goto free_ring;
 	}
+	/* the app owns nothing yet, hw pidx already trails descq->pidx */
+	for (i = 0; i < ring_sz; i++)
+		get_page(pages[i]);
+	ring->buf_cidx = descq->pidx;
+	descq->rx_ring = ring;
+	unlock_descq(descq);
+
+	/* the freelist pages do not move any more, map them in */
+	for (i = 0; i < ring_sz; i++) {
+		unsigned int j;
 
-	if (rx && rx->offset < rx->len) {
-		/* put back to the queue */
-		rxq_enqueue_head(rxq, rx);
+		for (j = 0; j < (1 << descq->st_c2h_pg_order) && !rv;
+		     j++, addr += PAGE_SIZE)
+			rv = vm_insert_page(vma, addr, pages[i] + j);
+		put_page(pages[i]);
 	}
+	kfree(pages);
+	if (!rv)
+		return 0;
 
-	spin_unlock(&rxq->lock);
+	/*
+	 * no usable mapping, back to read(): the packets posted meanwhile are
+	 * dropped and all of the freelist goes back to the hw
+	 */
+	pr_info("%s, rx buf insert page failed %d.\n", descq->conf.name, rv);
+	lock_descq(descq);
+	if (descq->rx_ring == ring) {
+		WRITE_ONCE(ring->hdr->cidx, ring->pidx);
+		rx_ring_reclaim(descq);
+		descq->rx_ring = NULL;
+	} else
+		/* stopped meanwhile, and freed along with the queue */
+		ring = NULL;
+	unlock_descq(descq);
+	if (ring)
+		rx_ring_free(ring);
+	return rv;
 
-	return copied;
+free_ring:
+	vfree(ring->hdr);
+free_pages:
+	kfree(ring);
+	kfree(pages);
+	return rv;
+}
+
+int qdma_descq_rx_ring_kick(struct qdma_descq *descq)
+{
+	int rv = 0;
+
+	lock_descq(descq);
+	if (descq->online && descq->rx_ring)
+		rv = descq_st_c2h_wb(descq);
+	else
+		rv = -EINVAL;
+	unlock_descq(descq);
+
+	return rv;
 }
 
 int qdma_descq_config(struct qdma_descq *descq, struct qdma_queue_conf *qconf,
-		 int reconfig)
+		 int reconfig, char *buf, int buflen)
 {
-	descq->conf.rngsz = RNG_SZ_DFLT;
-	descq->rngsz_wrb = WRB_RNG_SZ_DFLT;
+	char msg[64];
+
+	if (qconf->rngsz_idx >= QDMA_RNG_SZ_PROFILE_CNT ||
+	    qconf->wrb_rngsz_idx >= QDMA_RNG_SZ_PROFILE_CNT) {
+		snprintf(msg, sizeof(msg), "ring size idx %u,%u, max %d",
+			qconf->rngsz_idx, qconf->wrb_rngsz_idx,
+			QDMA_RNG_SZ_PROFILE_CNT - 1);
+		goto err_out;
+	}
+
+	if (qconf->c2h_bufsz_idx >= QDMA_C2H_BUF_SZ_CNT) {
+		snprintf(msg, sizeof(msg), "c2h buf size idx %u, max %d",
+			qconf->c2h_bufsz_idx, QDMA_C2H_BUF_SZ_CNT - 1);
+		goto err_out;
+	}
+
+	if (qconf->wrb_trig_mode > TRIG_MODE_USER ||
+	    qconf->wrb_timer_idx >= QDMA_C2H_TIMER_CNT_CNT ||
+	    qconf->wrb_cnt_idx >= QDMA_C2H_CNT_TH_CNT) {
+		snprintf(msg, sizeof(msg),
+			"trig mode %u, timer idx %u, cnt idx %u",
+			qconf->wrb_trig_mode, qconf->wrb_timer_idx,
+			qconf->wrb_cnt_idx);
+		goto err_out;
+	}
+
+	if (qconf->st_h2c_desc_len_max > ST_H2C_DESC_LEN_MAX) {
+		snprintf(msg, sizeof(msg), "desc len %u, max %u",
+			qconf->st_h2c_desc_len_max, ST_H2C_DESC_LEN_MAX);
+		goto err_out;
+	}
+
+	descq->conf.rngsz_idx = qconf->rngsz_idx;
+	descq->conf.rngsz = qdma_rng_sz_profile[qconf->rngsz_idx];
+	if (qconf->c2h && qconf->st) {
+		descq->conf.wrb_rngsz_idx = qconf->wrb_rngsz_idx;
+		descq->rngsz_wrb = qdma_rng_sz_profile[qconf->wrb_rngsz_idx];
+	} else {
+		descq->conf.wrb_rngsz_idx = RNG_SZ_DFLT_IDX;
+		descq->rngsz_wrb = WRB_RNG_SZ_DFLT;
+	}
 
 	/* we can never use the full ring because then cidx would equal pidx
 	 * and thus the ring would be interpreted as empty. Thus max number of
 	 * usable entries is ring_size - 1
 	 */
-	descq->avail = RNG_SZ_DFLT - 1;
+	descq->avail = descq->conf.rngsz - 1;
 
 	descq->pidx = 0;
 	descq->cidx = 0;
 	descq->cidx_wrb = 0;
 	descq->pidx_wrb = 0;
-	descq->credit = 0;
+	descq->pidx_db_pend = 0;
+	descq->stat_pidx_db = 0ULL;
+	descq->stat_bytes = 0ULL;
+	descq->stat_inline_submit = 0ULL;
+	descq->wb_more = false;
+	descq->stat_wb_resched = 0ULL;
+	descq->stat_busy_poll = 0ULL;
+	descq->conf.pidx_db_batch = qconf->pidx_db_batch;
+	descq->conf.inline_submit = qconf->inline_submit;
+	descq->conf.desc_bypass = qconf->desc_bypass;
+	descq->conf.st_h2c_desc_len_max = qconf->st_h2c_desc_len_max ?
+				qconf->st_h2c_desc_len_max :
+				ST_H2C_DESC_LEN_DFLT;
 	descq->irq_en = (descq->xdev->num_vecs) ? 1 : 0;
 	descq->wrb_stat_desc_en = 1;
 	descq->wrb_trig_mode = TRIG_MODE_ANY;
 	descq->wrb_timer_idx = 0;
-	descq->prefetch_en = descq->xdev->conf.pftch_en;
+	descq->wrb_cnt_idx = 0;
+	descq->coal_pkts = 0;
+	descq->coal_ts = jiffies;
+	descq->stat_coal_change = 0ULL;
+	if (qconf->c2h && qconf->st) {
+		if (qconf->pftch_en || qconf->pftch_dis)
+			descq->conf.pftch_en = qconf->pftch_en;
+		else
+			descq->conf.pftch_en =
+				descq->xdev->conf.pftch_en ? 1 : 0;
+		descq->conf.pftch_dis = 0;
+		descq->conf.pftch_bypass = qconf->pftch_bypass;
+		descq->conf.c2h_bufsz_idx = qconf->c2h_bufsz_idx;
+		descq->st_c2h_bufsz =
+			qdma_c2h_buf_sz_profile[qconf->c2h_bufsz_idx];
+		descq->st_c2h_pg_order = get_order(descq->st_c2h_bufsz);
+		descq->conf.rx_max_bytes = qconf->rx_max_bytes;
+		descq->conf.rx_max_pkts = qconf->rx_max_pkts;
+		descq->conf.rx_drop_oldest = qconf->rx_drop_oldest;
+		descq->conf.wb_budget = qconf->wb_budget ?
+					qconf->wb_budget :
+					ST_C2H_WB_BUDGET_DFLT;
+		descq->conf.busy_poll_us = qconf->busy_poll_us;
+		descq->conf.adaptive_coal = qconf->adaptive_coal;
+		descq->conf.wrb_trig_mode = qconf->wrb_trig_mode;
+		descq->conf.wrb_timer_idx = qconf->wrb_timer_idx;
+		descq->conf.wrb_cnt_idx = qconf->wrb_cnt_idx;
+		if (qconf->adaptive_coal) {
+			/* either the timer or the counter, from profile 0 */
+			descq->wrb_trig_mode = TRIG_MODE_COMBO;
+		} else {
+			if (qconf->wrb_trig_mode)
+				descq->wrb_trig_mode = qconf->wrb_trig_mode;
+			descq->wrb_timer_idx = qconf->wrb_timer_idx;
+			descq->wrb_cnt_idx = qconf->wrb_cnt_idx;
+		}
+	} else {
+		descq->conf.pftch_en = 0;
+		descq->conf.pftch_bypass = 0;
+		descq->conf.c2h_bufsz_idx = 0;
+		descq->conf.rx_max_bytes = 0;
+		descq->conf.rx_max_pkts = 0;
+		descq->conf.rx_drop_oldest = 0;
+		descq->conf.wb_budget = 0;
+		descq->conf.busy_poll_us = 0;
+		descq->conf.adaptive_coal = 0;
+		descq->conf.wrb_trig_mode = 0;
+		descq->conf.wrb_timer_idx = 0;
+		descq->conf.wrb_cnt_idx = 0;
+	}
+	descq->prefetch_en = descq->conf.pftch_en;
 	if (qconf->c2h && qconf->st) {
 	    descq->st_c2h_wrb_desc_size =
 			    (enum ctxt_desc_sz_sel)qconf->st_c2h_wrb_desc_size;
@@ -1242,6 +2126,14 @@ int qdma_descq_config(struct qdma_descq *descq, struct qdma_queue_conf *qconf,
 	}
 
 	return 0;
+
+err_out:
+	pr_info("%s, q %u, %s.\n",
+		descq->xdev->conf.name, descq->conf.qidx, msg);
+	if (buf && buflen > 0)
+		snprintf(buf, buflen, "%s, q %u, invalid %s.\n",
+			descq->xdev->conf.name, descq->conf.qidx, msg);
+	return -EINVAL;
 }
 
 int qdma_descq_prog_hw(struct qdma_descq *descq)
@@ -1263,25 +2155,117 @@ int qdma_descq_prog_hw(struct qdma_descq *descq)
 	return rv;
 }
 
-void qdma_descq_service_wb(struct qdma_descq *descq)
+/*
+ * qdma_descq_pidx_flush - ring the pidx doorbell for any descriptors written
+ *	but not yet handed to the hw. calling function should hold the lock
+ */
+void qdma_descq_pidx_flush(struct qdma_descq *descq)
+{
+	if (!descq->pidx_db_pend)
+		return;
+
+	descq->pidx_db_pend = 0;
+	descq_pidx_update(descq, descq->pidx);
+}
+
+/*
+ * descriptor bypass: copy the caller's descriptors into the ring as is and
+ * ring the doorbell, returns the # of descriptors taken.
+ * calling routine should hold the lock
+ */
+int qdma_descq_bypass_submit(struct qdma_descq *descq, const void *desc,
+				unsigned int desc_nr)
+{
+	int desc_sz = get_desc_size(descq);
+	unsigned int n = min_t(unsigned int, desc_nr, descq->avail);
+	unsigned int n1 = min_t(unsigned int, n,
+				descq->conf.rngsz - descq->pidx);
+
+	if (!n)
+		return 0;
+
+	memcpy(descq->desc + descq->pidx * desc_sz, desc, n1 * desc_sz);
+	if (n > n1)
+		memcpy(descq->desc, (const u8 *)desc + n1 * desc_sz,
+			(n - n1) * desc_sz);
+
+	descq->pidx += n;
+	if (descq->pidx >= descq->conf.rngsz)
+		descq->pidx -= descq->conf.rngsz;
+	descq->avail -= n;
+
+	descq->pidx_db_pend = 0;
+	descq_pidx_update(descq, descq->pidx);
+
+	if (descq->wbthp)
+		qdma_kthread_wakeup(descq->wbthp);
+
+	return n;
+}
+
+/* return > 0 if st c2h writebacks were left for another pass */
+int qdma_descq_service_wb(struct qdma_descq *descq)
 {
+	int more = 0;
+
 	lock_descq(descq);
-	if (descq->conf.st && descq->conf.c2h)
+	if (descq->conf.st && descq->conf.c2h) {
 		descq_st_c2h_wb(descq);
-	else
+		more = descq->wb_more;
+	} else
 		descq_mm_n_h2c_wb(descq);
 	unlock_descq(descq);
+
+	return more;
 }
 
 ssize_t qdma_descq_proc_sgt_request(struct qdma_descq *descq,
 					struct qdma_sgt_req_cb *cb)
 {
-	if(!descq->conf.st) /* MM H2C/C2H */
-		return descq_mm_proc_request(descq, cb);
-	else if (descq->conf.st && !descq->conf.c2h) /* ST H2C */
-		return descq_proc_st_h2c_request(descq, cb);
-	else	/* ST C2H - should not happen - handled separately */
+	/* ST C2H - should not happen - handled separately */
+	if (unlikely(!descq->fp_proc_request))
 		return -1;
+
+	return descq->fp_proc_request(descq, cb);
+}
+
+/* drop a request the caller gave up on, calling routine holds the lock */
+void qdma_descq_cancel_request(struct qdma_descq *descq,
+				struct qdma_sgt_req_cb *cb)
+{
+	if (descq->req_slot) {
+		int i;
+
+		for (i = 0; i < descq->conf.rngsz; i++)
+			if (descq->req_slot[i] == cb) {
+				descq->req_slot[i] = NULL;
+				break;
+			}
+	}
+	list_del(&cb->list);
+}
+
+/*
+ * fail every request still queued up or in flight, so that no non-blocking
+ * submitter is left waiting on a queue being stopped.
+ * calling routine holds the lock
+ */
+void qdma_descq_cancel_all(struct qdma_descq *descq)
+{
+	struct qdma_sgt_req_cb *cb, *tmp;
+
+	if (descq->req_slot)
+		memset(descq->req_slot, 0, descq->conf.rngsz *
+			sizeof(struct qdma_sgt_req_cb *));
+
+	list_for_each_entry_safe(cb, tmp, &descq->work_list, list) {
+		req_unmap(descq, cb);
+		qdma_sgt_req_done(cb, -ECANCELED);
+	}
+	list_for_each_entry_safe(cb, tmp, &descq->pend_list, list) {
+		req_unmap(descq, cb);
+		qdma_sgt_req_done(cb, -ECANCELED);
+	}
 }
 
 void qdma_sgt_req_done(struct qdma_sgt_req_cb *cb, int error)
@@ -1294,8 +2278,8 @@ void qdma_sgt_req_done(struct qdma_sgt_req_cb *cb, int error)
 
 	list_del(&cb->list);
 	if (req->fp_done) {
-		if (cb->offset != req->count) {
-			pr_info("req not completed %u != %u.\n",
+		if (!error && cb->offset != req->count) {
+			pr_info("req not completed %llu != %llu.\n",
 				cb->offset, req->count);
 			error = -EINVAL;
 		}
@@ -1436,9 +2420,45 @@ int qdma_descq_dump(struct qdma_descq *descq, char *buf, int buflen, int detail)
 		descq->desc, descq->desc_bus, descq->conf.rngsz);
 	if (descq->conf.st && descq->conf.c2h) {
 		len += sprintf(buf + len,
-			"\twrb desc 0x%p/0x%llx, %u, rxq 0x%x",
+			"\twrb desc 0x%p/0x%llx, %u, rxq 0x%x, %u/%u%s, "
+			"pftch %u,%u, "
+			"bufsz idx %u %u, pg pool %u, hit %llu, miss %llu",
 			descq->desc_wrb, descq->desc_wrb_bus, descq->rngsz_wrb,
-			descq->rx_queue.dlen);
+			descq->rx_queue.dlen, descq->rx_queue.cnt,
+			descq->rx_queue.size,
+			descq->rx_queue.stalled ? " stalled" : "",
+			descq->conf.pftch_en,
+			descq->conf.pftch_bypass, descq->conf.c2h_bufsz_idx,
+			descq->st_c2h_bufsz,
+			descq->pg_pool.cnt, descq->pg_pool.stat_hit,
+			descq->pg_pool.stat_miss);
+		len += sprintf(buf + len,
+			", rx max %u B %u pkts%s, stall %llu, drop %llu %llu B",
+			descq->conf.rx_max_bytes, descq->conf.rx_max_pkts,
+			descq->conf.rx_drop_oldest ? " drop" : "",
+			descq->rx_queue.stat_stall,
+			descq->rx_queue.stat_drop_pkts,
+			descq->rx_queue.stat_drop_bytes);
+		len += sprintf(buf + len,
+			", budget %u, resched %llu, busy poll %u us, %llu",
+			descq->conf.wb_budget, descq->stat_wb_resched,
+			descq->conf.busy_poll_us, descq->stat_busy_poll);
+		len += sprintf(buf + len,
+			", trig %u, timer idx %u, cnt idx %u, adaptive %u, %llu",
+			descq->wrb_trig_mode, descq->wrb_timer_idx,
+			descq->wrb_cnt_idx, descq->conf.adaptive_coal,
+			descq->stat_coal_change);
+		if (descq->rx_ring)
+			len += sprintf(buf + len,
+				", rx ring %u/%u, pkts %llu, full %llu",
+				descq->rx_ring->pidx, descq->rx_ring->cidx,
+				descq->rx_ring->stat_pkts,
+				descq->rx_ring->stat_full);
+	} else {
+		len += sprintf(buf + len,
+			"\tpidx db %llu, batch %u, bytes %llu, inline %llu",
+			descq->stat_pidx_db, descq->conf.pidx_db_batch,
+			descq->stat_bytes, descq->stat_inline_submit);
 	}
 
 	if (!detail)
@@ -13,10 +13,13 @@
 #ifndef __QDMA_DESCQ_H__
 #define __QDMA_DESCQ_H__
 
+#include <linux/cache.h>
 #include <linux/spinlock_types.h>
+#include <linux/wait.h>
 
 #include "libqdma_export.h"
 #include "qdma_regs.h"
+#include "qdma_ioctl.h"
 
 struct fl_desc {
 	struct page *pg;
@@ -24,39 +27,94 @@ struct fl_desc {
 	unsigned int len;
 };
 
-struct st_c2h_wrb_udd {
-	unsigned char *data; /* pointer to the buffer that contains user defined data. */
-	unsigned char udd_len; /* Max 236 bits */
+/* st c2h wrb entries processed per pass, see qdma_queue_conf.wb_budget */
+#define ST_C2H_WB_BUDGET_DFLT	64
+
+/* user defined data of a wrb entry: 64B entry less the dma info, + 1 nibble */
+#define ST_C2H_UDD_MAX		(64 - L_C2H_WB_ENTRY_DMA_INFO + 1)
+
+struct st_rx_udd {
+	unsigned char len;	/* 0 if none */
 	unsigned char offset;
-	struct st_c2h_wrb_udd *next;
+	unsigned char data[ST_C2H_UDD_MAX];
 };
 
+/* a freelist page handed to the rx queue, pg is NULL for a udd only entry */
 struct st_rx_data {
 	struct page *pg;
+	dma_addr_t dma_addr;	/* pg stays mapped, see st_rx_pg_pool */
 	unsigned int offset;
 	unsigned int len;
-	struct st_c2h_wrb_udd *udd_ref; /* a reference to corresponding user defined data of the packet.
-                                                  Non zero if start of packet and NULL for other entries */
-	struct st_rx_data *next;
+#define ST_RX_F_SOP	0x1	/* first entry of a packet */
+#define ST_RX_F_EOP	0x2	/* last entry of a packet */
+#define ST_RX_F_ERR	0x4	/* wrb entry flagged an error */
+	unsigned int flags;
 };
 
+/*
+ * st c2h received data waiting for the reader: a ring of size entries
+ * allocated with the queue. The user defined data of a packet sits in the
+ * udd slot of its first entry and is read ahead of the packet data.
+ */
 struct st_rx_queue {
 	spinlock_t lock;
-	unsigned int dlen;
-	//unsigned int dlen_max;
-	/* pointers to maintain a list of user defined data entries.
-	 * Maintaining as a separate list as a separate call may be
-	 * used to retrieve this data other than retrieving actual data */
-	struct st_c2h_wrb_udd *udd_head;
-	struct st_c2h_wrb_udd *udd_tail;
-	struct st_rx_data *head;
-	struct st_rx_data *tail;
+	unsigned int dlen;	/* # of bytes, udd included */
+	unsigned int size;
+	unsigned int cnt;	/* # of entries in use */
+	unsigned int pidx;
+	unsigned int cidx;
+	unsigned int pkt_cnt;	/* # of complete packets */
+	bool stalled;		/* wrb processing stopped, queue full */
+	bool capped;		/* full, dropping the oldest packets */
+	wait_queue_head_t pkt_wq;	/* packet mode readers */
+	struct st_rx_data *data;
+	struct st_rx_udd *udd;	/* parallel to data, if udd is enabled */
+
+	/* statistics */
+	unsigned long long stat_stall;		/* # of times stalled */
+	unsigned long long stat_drop_pkts;	/* # of oldest pkts dropped */
+	unsigned long long stat_drop_bytes;
+};
+
+/*
+ * st c2h: pages the reader is done with, kept dma mapped and handed back
+ * to the freelist on refill
+ */
+struct st_rx_pg_pool {
+	spinlock_t lock;
+	unsigned int cnt;
+	unsigned int max;
+	struct fl_desc *pg_list;
+	unsigned long long stat_hit;	/* refill served from the pool */
+	unsigned long long stat_miss;	/* refill had to alloc & map a page */
+};
+
+/*
+ * st c2h: receive ring mmap'ed by the application, the freelist pages are
+ * handed out in place instead of going through the rx_queue
+ */
+struct st_rx_ring {
+	struct qdma_rx_ring_hdr *hdr;	/* vmalloc_user'ed, hdr + entries */
+	struct qdma_rx_ring_ent *ent;
+	unsigned int len;		/* hdr + entries, page aligned */
+	unsigned int ring_sz;
+	unsigned int pidx;		/* next entry to post */
+	unsigned int cidx;		/* next entry to get back */
+	unsigned int buf_cidx;		/* first freelist entry with the app */
+	u16 *buf_cnt;			/* per entry, # of freelist entries */
+	unsigned long long stat_pkts;
+	unsigned long long stat_full;	/* writeback stalled, ring full */
 };
 
+/*
+ * the submission (producer) and writeback (consumer) sides usually run on
+ * different cpus: keep their hot fields on separate cache lines, away from
+ * the configuration which is read mostly once the queue is online.
+ */
 struct qdma_descq {
+	/* cold: configuration & resources */
 	struct qdma_queue_conf conf;
 
-	spinlock_t lock;
 	struct xlnx_dma_dev *xdev;
 #define FUNC_ID_INVALID		0xFF
 	u8 channel;
@@ -72,6 +130,7 @@ struct qdma_descq {
 	u32 wrb_stat_desc_en;
 	u32 wrb_trig_mode;
 	u32 wrb_timer_idx;
+	u32 wrb_cnt_idx;
 
 	unsigned int qidx_hw;
 
@@ -83,39 +142,76 @@ struct qdma_descq {
 	struct qdma_kthread *wrkthp;
 	struct list_head wrkthp_list;
 
-	struct list_head work_list;
-
 	spinlock_t wb_lock;
 	struct qdma_kthread *wbthp;
 	struct list_head wbthp_list;
 
-	struct list_head pend_list;
+	/* poll()/epoll on the queue's character device */
+	wait_queue_head_t poll_wq;
 
-	unsigned int avail;
-	unsigned int pend;
-	unsigned int pidx;
-	unsigned int cidx;
-	unsigned int credit;
 	u8 *desc;
 	dma_addr_t desc_bus;
 
 	u8 *desc_wb;
 
+	/* MM & ST H2C: per desc. slot, the request whose last desc. sits
+	 * there, NULL otherwise */
+	struct qdma_sgt_req_cb **req_slot;
+
 	/* ST C2H */
-	struct st_rx_queue rx_queue;
 	unsigned int rngsz_wrb;
-	unsigned int pidx_wrb;
-	unsigned int cidx_wrb;
 	enum ctxt_desc_sz_sel st_c2h_wrb_desc_size;
 	bool st_c2h_wrb_udd_en; /* flag to indicate if user defined data accumulation is enabled */
 	unsigned char st_c2h_wrb_entry_len;
+	unsigned int st_c2h_bufsz;	/* freelist buffer, per c2h_bufsz_idx */
+	unsigned int st_c2h_pg_order;	/* freelist pages to hold one */
 	struct fl_desc *st_rx_fl;
-	void *desc_wrb_cur; /* data type void as there are 3 possible sizes to it  */
 	u8 *desc_wrb;
 	dma_addr_t desc_wrb_bus;
 	u8 *desc_wrb_wb;
-	int (*fp_rx_handler)(unsigned long, struct fl_desc *, int, struct st_c2h_wrb_udd *);
+	int (*fp_rx_handler)(unsigned long, struct fl_desc *, int,
+				unsigned int flags, const unsigned char *udd,
+				unsigned int udd_len);
 	unsigned long arg;
+
+	/* MM & ST H2C: builds the descriptors for a request, per queue type */
+	ssize_t (*fp_proc_request)(struct qdma_descq *,
+				struct qdma_sgt_req_cb *);
+
+	/* taken by both sides */
+	spinlock_t lock ____cacheline_aligned_in_smp;
+
+	/* hot, producer: request submission */
+	struct list_head work_list ____cacheline_aligned_in_smp;
+	unsigned int avail;
+	unsigned int pidx;
+	unsigned int pidx_db_pend;	/* desc. written, doorbell not rung */
+
+	/* statistics */
+	unsigned long long stat_pidx_db;	/* # of pidx doorbells */
+	unsigned long long stat_bytes;		/* # of bytes submitted */
+	unsigned long long stat_inline_submit;	/* # of inline submissions */
+
+	/* hot, consumer: writeback processing */
+	struct list_head pend_list ____cacheline_aligned_in_smp;
+	unsigned int pend;
+	unsigned int cidx;
+
+	/* ST C2H */
+	unsigned int pidx_wrb;
+	unsigned int cidx_wrb;
+	bool wb_more;		/* the last pass ran out of budget */
+	/* adaptive moderation: wrb entries seen since coal_ts */
+	unsigned int coal_pkts;
+	unsigned long coal_ts;
+	unsigned long long stat_coal_change;	/* # of profile changes */
+	unsigned long long stat_wb_resched;	/* # of passes cut short */
+	unsigned long long stat_busy_poll;	/* # of waits polled out */
+	void *desc_wrb_cur; /* data type void as there are 3 possible sizes to it  */
+	struct st_rx_queue rx_queue;
+	struct st_rx_pg_pool pg_pool;
+	struct st_rx_ring *rx_ring;	/* set once the ring is mmap'ed */
+	unsigned int rx_pkt_waiters;	/* packet mode readers waiting */
 };
 
 #define lock_descq(descq)	\
@@ -135,7 +231,7 @@ void qdma_descq_init(struct qdma_descq *descq, struct xlnx_dma_dev *xdev, int id
 		int idx_sw);
 
 int qdma_descq_config(struct qdma_descq *descq, struct qdma_queue_conf *qconf,
-		 int reconfig);
+		 int reconfig, char *buf, int buflen);
 
 void qdma_descq_cleanup(struct qdma_descq *descq);
 
@@ -147,10 +243,21 @@ int qdma_descq_prog_hw(struct qdma_descq *descq);
 
 int qdma_descq_context_cleanup(struct qdma_descq *descq);
 
-void qdma_descq_service_wb(struct qdma_descq *descq);
+int qdma_descq_service_wb(struct qdma_descq *descq);
+
+void qdma_descq_pidx_flush(struct qdma_descq *descq);
+int qdma_descq_bypass_submit(struct qdma_descq *descq, const void *desc,
+				unsigned int desc_nr);
 
 int qdma_descq_rxq_read(struct qdma_descq *descq, struct sg_table *sgt,
                 unsigned int count);
+int qdma_descq_rxq_read_pkts(struct qdma_descq *descq,
+				struct qdma_pkt_req *req);
+
+struct vm_area_struct;
+int qdma_descq_rx_ring_mmap(struct qdma_descq *descq,
+				struct vm_area_struct *vma);
+int qdma_descq_rx_ring_kick(struct qdma_descq *descq);
 
 
 int qdma_descq_dump(struct qdma_descq *descq, char *buf, int buflen, int detail);
@@ -169,8 +276,11 @@ int qdma_descq_dump_state(struct qdma_descq *descq, char *buf);
 struct qdma_sgt_req_cb {
 	struct list_head list;
 	wait_queue_head_t wq;
-	unsigned int desc_nr;
-	unsigned int offset;
+	u64 offset;			/* bytes submitted */
+	/* resume cursor: next sg entry to submit and the offset into it */
+	struct scatterlist *sg;
+	unsigned int sg_idx;
+	unsigned int sg_offset;
 	unsigned int done;
 	int status;
 };
@@ -180,6 +290,9 @@ ssize_t qdma_descq_proc_sgt_request(struct qdma_descq *descq,
 		struct qdma_sgt_req_cb *cb);
 
 void qdma_sgt_req_done(struct qdma_sgt_req_cb *cb, int error);
+void qdma_descq_cancel_request(struct qdma_descq *descq,
+		struct qdma_sgt_req_cb *cb);
+void qdma_descq_cancel_all(struct qdma_descq *descq);
 
 
 #endif /* ifndef __QDMA_DESCQ_H__ */
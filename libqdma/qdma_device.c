@@ -136,6 +136,16 @@ int qdma_device_init(struct xlnx_dma_dev *xdev)
 	}
 #endif
 
+	/* the descriptor bypass BAR is the one left after config and user */
+	for (i = 0; i < XDMA_MAX_BARS; i++) {
+		if (xdev->bar[i] && i != xdev->conf.bar_num_config &&
+		    i != xdev->conf.bar_num_user) {
+			xdev->conf.bar_num_bypass = i;
+			pr_info("%s Bypass BAR %d.\n", xdev->conf.name, i);
+			break;
+		}
+	}
+
 	rv = intr_setup(xdev);
 	if (rv)
 		return -EINVAL;
@@ -146,8 +156,10 @@ int qdma_device_init(struct xlnx_dma_dev *xdev)
 		return -EINVAL;
 	}
 
-	qdev = kzalloc(sizeof(struct qdma_dev) +
-			sizeof(struct qdma_descq) * qmax * 2, GFP_KERNEL);
+	/* on the device's numa node, the descqs start on a cache line */
+	qdev = kzalloc_node(QDMA_DEV_ALIGNED_SZ +
+			sizeof(struct qdma_descq) * qmax * 2, GFP_KERNEL,
+			dev_to_node(&xdev->conf.pdev->dev));
 	if (!qdev) {
 		pr_info("dev %s qmax %d OOM.\n",
 			dev_name(&xdev->conf.pdev->dev), qmax);
@@ -157,7 +169,7 @@ int qdma_device_init(struct xlnx_dma_dev *xdev)
 
 	spin_lock_init(&qdev->lock);
 
-	descq = (struct qdma_descq *)(qdev + 1);
+	descq = (struct qdma_descq *)((u8 *)qdev + QDMA_DEV_ALIGNED_SZ);
 	qdev->h2c_descq = descq;
 	qdev->c2h_descq = descq + qmax;
 
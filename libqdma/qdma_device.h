@@ -13,6 +13,7 @@
 #ifndef LIBQDMA_QDMA_DEVICE_H_
 #define LIBQDMA_QDMA_DEVICE_H_
 
+#include <linux/cache.h>
 #include <linux/spinlock_types.h>
 
 struct qdma_descq;
@@ -33,6 +34,9 @@ struct qdma_dev {
 	struct qdma_descq *c2h_descq;
 };
 
+/* the descq arrays are placed right after struct qdma_dev */
+#define QDMA_DEV_ALIGNED_SZ	ALIGN(sizeof(struct qdma_dev), L1_CACHE_BYTES)
+
 #define xdev_2_qdev(xdev)	(struct qdma_dev *)((xdev)->dev_priv)
 
 int qdma_device_init(struct xlnx_dma_dev *);
@@ -330,5 +330,7 @@ void intr_work(struct work_struct *work)
 	struct qdma_descq *descq;
 
 	descq = container_of(work, struct qdma_descq, work);
-	qdma_descq_service_wb(descq);
+	/* out of budget: requeue behind the other queues' work */
+	if (qdma_descq_service_wb(descq) > 0)
+		schedule_work(&descq->work);
 }
@@ -21,6 +21,46 @@
 
 #include "xdev.h"
 
+/*
+ * descriptor ring size profiles (# of descriptors), the value programmed into
+ * the global ring size register includes the writeback status entry, so the
+ * largest profile still fits into the 16-bit register.
+ */
+const unsigned int qdma_rng_sz_profile[QDMA_RNG_SZ_PROFILE_CNT] = {
+	RNG_SZ_DFLT,	/* 0: default */
+	64, 128, 512, 1024, 2048, 3072, 4096, 6144, 8192, 12288, 16384,
+	24576, 32768, 49152, 65534
+};
+
+/*
+ * st c2h buffer size profiles (bytes), a packet longer than the buffer is
+ * spread over several descriptors. 9018 holds a 9000 byte jumbo frame mtu
+ * plus the ethernet header and fcs in a single buffer. The wrb entry length
+ * field is 16 bits, so the largest size is the last page multiple that
+ * still fits in it.
+ */
+const unsigned int qdma_c2h_buf_sz_profile[QDMA_C2H_BUF_SZ_CNT] = {
+	C2H_BUF_SZ_DFLT,	/* 0: default */
+	256, 512, 1024, 2048, 4096, 8192, 9018, 12288, 16384, 24576, 32768,
+	40960, 49152, 57344, 61440
+};
+
+/*
+ * st c2h writeback moderation profiles: the timer counts (in the timer's
+ * ticks) and the counter thresholds (# of wrb entries) grow together, so
+ * the same index for both gives a step in coalescing, see the adaptive
+ * moderation in qdma_descq.c
+ */
+const unsigned int qdma_c2h_timer_cnt_profile[QDMA_C2H_TIMER_CNT_CNT] = {
+	C2H_TIMER_CNT_DFLT,	/* 0: default */
+	2, 4, 5, 8, 10, 15, 20, 25, 30, 50, 75, 100, 125, 150, 200
+};
+
+const unsigned int qdma_c2h_cnt_th_profile[QDMA_C2H_CNT_TH_CNT] = {
+	C2H_CNT_TH_DFLT,	/* 0: default */
+	2, 4, 8, 16, 24, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176
+};
+
 /*
  * hw_monitor_reg() - polling a register repeatly until 
  *	(the register value & mask) == val or time is up
@@ -68,19 +108,19 @@ void hw_set_global_csr(struct xlnx_dma_dev *xdev)
 
 	reg = QDMA_REG_GLBL_RNG_SZ_BASE;
 	for (i = 0; i < QDMA_REG_GLBL_RNG_SZ_COUNT; i++, reg += 4)
-		__write_reg(xdev, reg, RNG_SZ_DFLT + 1);
+		__write_reg(xdev, reg, qdma_rng_sz_profile[i] + 1);
 
 	reg = QDMA_REG_C2H_BUF_SZ_BASE;
 	for (i = 0; i < QDMA_REG_C2H_BUF_SZ_COUNT; i++, reg += 4)
-		__write_reg(xdev, reg, C2H_BUF_SZ_DFLT);
+		__write_reg(xdev, reg, qdma_c2h_buf_sz_profile[i]);
 
 	reg = QDMA_REG_C2H_TIMER_CNT_BASE;
 	for (i = 0; i < QDMA_REG_C2H_TIMER_CNT_COUNT; i++, reg += 4)
-		__write_reg(xdev, reg, C2H_TIMER_CNT_DFLT);
+		__write_reg(xdev, reg, qdma_c2h_timer_cnt_profile[i]);
 
 	reg = QDMA_REG_C2H_CNT_TH_BASE;
 	for (i = 0; i < QDMA_REG_C2H_CNT_TH_COUNT; i++, reg += 4)
-		__write_reg(xdev, reg, C2H_CNT_TH_DFLT);
+		__write_reg(xdev, reg, qdma_c2h_cnt_th_profile[i]);
 }
 
 void hw_mm_channel_enable(struct xlnx_dma_dev *xdev, int channel, bool c2h)
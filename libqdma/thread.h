@@ -26,6 +26,7 @@ struct qdma_kthread {
 	unsigned short id;
 	unsigned int timeout;
 	unsigned long flag;
+	bool repoll;		/* idle work wants another look in a jiffy */
 	wait_queue_head_t waitq;
 	struct task_struct *task;
 
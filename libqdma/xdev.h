@@ -165,8 +165,6 @@ int xdev_sriov_vf_fmap(struct xlnx_dma_dev *xdev, u8 func_id,
 #define xdev_sriov_vf_online(xdev, func_id)
 #endif
 
-int sgt_find_offset(struct sg_table *, unsigned int, struct scatterlist **,
-		unsigned int *);
 void sgt_dump(struct sg_table *);
 
 #endif /* XDMA_LIB_H */
@@ -0,0 +1,326 @@
+/*
+ * This file is part of the Xilinx DMA IP Core driver tools for Linux
+ *
+ * Copyright (c) 2017-present,  Xilinx, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under both the BSD-style license (found in the
+ * LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ * in the COPYING file in the root directory of this source tree).
+ * You may select, at your option, one of the above-listed licenses.
+ */
+
+/*
+ * cross-cpu submit/complete benchmark: depth threads pinned to one cpu keep
+ * a transfer each in flight on a queue. The driver submits from the calling
+ * cpu and processes the writebacks on the queue's qdma_wb_th<cpu> thread
+ * (see "q dump"), so running once with the submitting cpu equal to that of
+ * the writeback thread and once with a different one shows what the two
+ * sides cost each other when they run apart.
+ */
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include <sys/types.h>
+
+#include "dma_utils.c"
+
+static struct option const long_opts[] = {
+	{"device", required_argument, NULL, 'd'},
+	{"address", required_argument, NULL, 'a'},
+	{"size", required_argument, NULL, 's'},
+	{"count", required_argument, NULL, 'c'},
+	{"depth", required_argument, NULL, 'q'},
+	{"submit cpu", required_argument, NULL, 'S'},
+	{"read", no_argument, NULL, 'r'},
+	{"help", no_argument, NULL, 'h'},
+	{"verbose", no_argument, NULL, 'v'},
+	{0, 0, 0, 0}
+};
+
+#define DEVICE_NAME_DEFAULT "/dev/qdma0-MM-H2C-0"
+#define SIZE_DEFAULT (4096)
+#define COUNT_DEFAULT (100000)
+#define DEPTH_DEFAULT (4)
+#define DEPTH_MAX (256)
+
+struct bench {
+	int fd;
+	uint64_t addr;
+	uint64_t size;
+	uint64_t count;
+	int c2h;
+	uint64_t next;			/* next transfer to issue */
+};
+
+/* one submitting thread, a single blocking transfer in flight */
+struct worker {
+	struct bench *b;
+	pthread_t thread;
+	char *buf;
+	uint64_t done;
+	uint64_t errors;
+	uint64_t lat_total;		/* nsec */
+	uint64_t lat_max;
+};
+
+static void *submit_thread(void *arg)
+{
+	struct worker *w = arg;
+	struct bench *b = w->b;
+
+	while (__sync_fetch_and_add(&b->next, 1) < b->count) {
+		struct timespec ts_start, ts_end;
+		ssize_t rc;
+		uint64_t ns;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts_start);
+		if (b->c2h)
+			rc = pread(b->fd, w->buf, b->size, b->addr);
+		else
+			rc = pwrite(b->fd, w->buf, b->size, b->addr);
+		clock_gettime(CLOCK_MONOTONIC, &ts_end);
+
+		if (rc < 0) {
+			perror(b->c2h ? "read" : "write");
+			w->errors++;
+			break;
+		}
+		if (rc != b->size)
+			w->errors++;
+
+		timespec_sub(&ts_end, &ts_start);
+		ns = ts_end.tv_sec * 1000000000ULL + ts_end.tv_nsec;
+		w->lat_total += ns;
+		if (ns > w->lat_max)
+			w->lat_max = ns;
+		w->done++;
+	}
+
+	return NULL;
+}
+
+static int test_dma(char *devname, uint64_t addr, uint64_t size,
+		    uint64_t count, unsigned int depth, int cpu, int c2h);
+
+static void usage(const char *name)
+{
+	int i = 0;
+
+	fprintf(stdout, "%s\n\n", name);
+	fprintf(stdout, "usage: %s [OPTIONS]\n\n", name);
+	fprintf(stdout,
+		"Keep transfers in flight from threads pinned to one cpu.\n\n");
+
+	fprintf(stdout, "  -%c (--%s) device (defaults to %s)\n",
+		long_opts[i].val, long_opts[i].name, DEVICE_NAME_DEFAULT);
+	i++;
+	fprintf(stdout, "  -%c (--%s) the start address on the AXI bus\n",
+		long_opts[i].val, long_opts[i].name);
+	i++;
+	fprintf(stdout,
+		"  -%c (--%s) size of a single transfer in bytes, default %d\n",
+		long_opts[i].val, long_opts[i].name, SIZE_DEFAULT);
+	i++;
+	fprintf(stdout, "  -%c (--%s) number of transfers, default %d\n",
+		long_opts[i].val, long_opts[i].name, COUNT_DEFAULT);
+	i++;
+	fprintf(stdout,
+		"  -%c (--%s) transfers (threads) in flight, default %d, max %d\n",
+		long_opts[i].val, long_opts[i].name, DEPTH_DEFAULT, DEPTH_MAX);
+	i++;
+	fprintf(stdout, "  -%c (--%s) cpu to submit on, default unpinned\n",
+		long_opts[i].val, long_opts[i].name);
+	i++;
+	fprintf(stdout, "  -%c (--%s) read (c2h) instead of write (h2c)\n",
+		long_opts[i].val, long_opts[i].name);
+	i++;
+	fprintf(stdout, "  -%c (--%s) print usage help and exit\n",
+		long_opts[i].val, long_opts[i].name);
+	i++;
+	fprintf(stdout, "  -%c (--%s) verbose output\n",
+		long_opts[i].val, long_opts[i].name);
+	i++;
+}
+
+int main(int argc, char *argv[])
+{
+	int cmd_opt;
+	char *device = DEVICE_NAME_DEFAULT;
+	uint64_t address = 0;
+	uint64_t size = SIZE_DEFAULT;
+	uint64_t count = COUNT_DEFAULT;
+	unsigned int depth = DEPTH_DEFAULT;
+	int cpu = -1;
+	int c2h = 0;
+
+	while ((cmd_opt = getopt_long(argc, argv, "vhrd:a:s:c:q:S:",
+				long_opts, NULL)) != -1) {
+		switch (cmd_opt) {
+		case 0:
+			/* long option */
+			break;
+		case 'd':
+			/* device node name */
+			device = strdup(optarg);
+			break;
+		case 'a':
+			/* RAM address on the AXI bus in bytes */
+			address = getopt_integer(optarg);
+			break;
+		case 's':
+			/* size in bytes */
+			size = getopt_integer(optarg);
+			break;
+		case 'c':
+			count = getopt_integer(optarg);
+			break;
+		case 'q':
+			depth = getopt_integer(optarg);
+			break;
+		case 'S':
+			cpu = getopt_integer(optarg);
+			break;
+		case 'r':
+			c2h = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+			/* print usage help and exit */
+		case 'h':
+		default:
+			usage(argv[0]);
+			exit(0);
+			break;
+		}
+	}
+
+	if (!size || size > RW_MAX_SIZE || !count || !depth ||
+	    depth > DEPTH_MAX) {
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	if (verbose)
+		fprintf(stdout,
+		"dev %s, address 0x%lx, size 0x%lx, count %lu, depth %u, "
+		"cpu %d, %s\n",
+		device, address, size, count, depth, cpu,
+		c2h ? "read" : "write");
+
+	return test_dma(device, address, size, count, depth, cpu, c2h);
+}
+
+static int test_dma(char *devname, uint64_t addr, uint64_t size,
+		    uint64_t count, unsigned int depth, int cpu, int c2h)
+{
+	struct bench b;
+	struct worker *workers;
+	struct timespec ts_start, ts_end;
+	pthread_attr_t attr;
+	uint64_t done = 0, errors = 0, lat_total = 0, lat_max = 0;
+	unsigned int started = 0;
+	unsigned int i;
+	double sec;
+	int rc = 0;
+
+	memset(&b, 0, sizeof(b));
+	b.fd = open(devname, O_RDWR);
+	if (b.fd < 0) {
+		fprintf(stderr, "unable to open device %s, %d.\n",
+			devname, b.fd);
+		perror("open device");
+		return -EINVAL;
+	}
+	b.addr = addr;
+	b.size = size;
+	b.count = count;
+	b.c2h = c2h;
+
+	workers = calloc(depth, sizeof(struct worker));
+	if (!workers) {
+		fprintf(stderr, "OOM %u workers.\n", depth);
+		rc = -ENOMEM;
+		goto close_fd;
+	}
+	for (i = 0; i < depth; i++) {
+		workers[i].b = &b;
+		posix_memalign((void **)&workers[i].buf, 4096, size);
+		if (!workers[i].buf) {
+			fprintf(stderr, "OOM %lu.\n", size);
+			rc = -ENOMEM;
+			goto free_bufs;
+		}
+		memset(workers[i].buf, i, size);
+	}
+
+	/* pinned from the start, so a bad cpu fails here */
+	pthread_attr_init(&attr);
+	if (cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
+	for (; started < depth; started++) {
+		rc = pthread_create(&workers[started].thread, &attr,
+				submit_thread, &workers[started]);
+		if (rc) {
+			fprintf(stderr, "unable to start thread %u, %d.\n",
+				started, rc);
+			rc = -rc;
+			/* let the running threads finish early */
+			__sync_fetch_and_add(&b.next, count);
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		done += workers[i].done;
+		errors += workers[i].errors;
+		lat_total += workers[i].lat_total;
+		if (workers[i].lat_max > lat_max)
+			lat_max = workers[i].lat_max;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+
+	timespec_sub(&ts_end, &ts_start);
+	sec = ts_end.tv_sec + ts_end.tv_nsec / 1000000000.0;
+
+	if (done) {
+		printf("** %s, %lu x %lu bytes, depth %u, cpu %d\n",
+			devname, done, size, started, cpu);
+		printf("** %.0f IOPS, BW %f MB/s, latency avg %.3f usec, "
+			"max %.3f usec, errors %lu\n",
+			done / sec, (double)done * size / sec / 1000000,
+			(double)lat_total / done / 1000,
+			(double)lat_max / 1000, errors);
+	}
+	if (!rc && (done != count || errors))
+		rc = -EIO;
+
+free_bufs:
+	for (i = 0; i < depth; i++)
+		free(workers[i].buf);
+	free(workers);
+close_fd:
+	close(b.fd);
+
+	return rc;
+}
@@ -18,9 +18,55 @@ static void __attribute__((noreturn)) usage(FILE *fp)
 	fprintf(fp,
 		"\t\tq list                           list all queues\n"
 		"\t\tq add idx <N> [mode <mm|st>] [dir <h2c|c2h>] [cdev <0|1>]\n"
+		"\t\t      [ringsz <0~15>] [wrb_ringsz <0~15>] [db_batch <N>]\n"
+		"\t\t      [desc_len <N>] [inline <0|1>] [bypass <0|1>]\n"
+		"\t\t      [pfetch <0|1>] [pfetch_byp <0|1>] [bufsz <0~15>]\n"
+		"\t\t      [wb_budget <N>] [busy_poll <us>]\n"
+		"\t\t      [trig_mode <any|timer|cntr|combo|user>]\n"
+		"\t\t      [timer_idx <0~15>] [cnt_idx <0~15>] [adaptive <0|1>]\n"
+		"\t\t      [rx_bytes <N>] [rx_pkts <N>] [rx_drop <0|1>]\n"
 		"\t\t                                 add a queue\n"
 		"\t\t                                    *mode default to mm\n"
 		"\t\t                                    *dir default to h2c\n"
+		"\t\t                                    *ringsz: desc ring size profile\n"
+		"\t\t                                     idx, default to 0 (256)\n"
+		"\t\t                                    *wrb_ringsz: st c2h wrb ring\n"
+		"\t\t                                     size profile idx, default to 0\n"
+		"\t\t                                    *db_batch: st h2c, ring pidx\n"
+		"\t\t                                     doorbell every N desc., default\n"
+		"\t\t                                     to 0 (once per request)\n"
+		"\t\t                                    *desc_len: st h2c, max. bytes\n"
+		"\t\t                                     per desc., up to 65535,\n"
+		"\t\t                                     default to 0 (page size)\n"
+		"\t\t                                    *inline: mm & st h2c, submit in\n"
+		"\t\t                                     the caller's context when the\n"
+		"\t\t                                     ring has room, default to 0\n"
+		"\t\t                                    *bypass: descriptor bypass mode,\n"
+		"\t\t                                     default to 0\n"
+		"\t\t                                    *pfetch, pfetch_byp, bufsz: st c2h\n"
+		"\t\t                                     prefetch enable, prefetch bypass\n"
+		"\t\t                                     and buffer size idx. pfetch\n"
+		"\t\t                                     defaults to the pftch_en module\n"
+		"\t\t                                     param\n"
+		"\t\t                                    *wb_budget: st c2h, max. wrb\n"
+		"\t\t                                     entries per pass, up to 65535,\n"
+		"\t\t                                     default to 0 (64)\n"
+		"\t\t                                    *busy_poll: st c2h, a blocked\n"
+		"\t\t                                     reader polls for up to <us>\n"
+		"\t\t                                     before sleeping, default to 0\n"
+		"\t\t                                    *trig_mode, timer_idx, cnt_idx:\n"
+		"\t\t                                     st c2h wrb interrupt trigger,\n"
+		"\t\t                                     timer and counter threshold\n"
+		"\t\t                                     profile idx, default to any,0,0\n"
+		"\t\t                                    *adaptive: st c2h, pick the\n"
+		"\t\t                                     timer/counter profile by the\n"
+		"\t\t                                     packet rate, default to 0\n"
+		"\t\t                                    *rx_bytes, rx_pkts: st c2h, max.\n"
+		"\t\t                                     bytes/packets held for the\n"
+		"\t\t                                     reader, default to 0 (no limit)\n"
+		"\t\t                                    *rx_drop: st c2h, drop the oldest\n"
+		"\t\t                                     packets at the limit instead of\n"
+		"\t\t                                     stalling, default to 0\n"
 		"\t\tq start idx <N> [dir <h2c|c2h>]  start a queue\n"
 		"\t\tq start idx <N> dir [<h2c|c2h>]  start a queue\n"
 		"\t\tq stop idx <N> dir [<h2c|c2h>]   stop a queue\n"
@@ -223,7 +269,7 @@ static int read_range(int argc, char *argv[], int i, unsigned int *v1,
 	return ++i;
 }
 
-static char qparm_type_str[][8] = {
+static char qparm_type_str[][12] = {
 	"idx",
 	"mode",
 	"dir",
@@ -232,6 +278,32 @@ static char qparm_type_str[][8] = {
 	"cdev",
 	"desc",
 	"wrb",
+	"wrbsz",
+	"wrb_ringsz",
+	"db_batch",
+	"desc_len",
+	"inline",
+	"bypass",
+	"pfetch",
+	"pfetch_byp",
+	"wb_budget",
+	"busy_poll",
+	"trig_mode",
+	"timer_idx",
+	"cnt_idx",
+	"adaptive",
+	"rx_bytes",
+	"rx_pkts",
+	"rx_drop",
+};
+
+/* st c2h wrb trigger modes, as encoded in the wrb context, from 1 */
+static char trig_mode_str[][8] = {
+	"any",
+	"timer",
+	"cntr",
+	"combo",
+	"user",
 };
 
 static int read_qparm(int argc, char *argv[], int i, struct xcmd_q_parm *qparm,
@@ -245,6 +317,22 @@ static int read_qparm(int argc, char *argv[], int i, struct xcmd_q_parm *qparm,
 	/*
 	 * idx <val>
 	 * ringsz <val>
+	 * wrb_ringsz <val>
+	 * db_batch <val>
+	 * desc_len <val>
+	 * inline <0|1>
+	 * bypass <0|1>
+	 * pfetch <0|1>
+	 * pfetch_byp <0|1>
+	 * wb_budget <val>
+	 * busy_poll <val>
+	 * trig_mode <any|timer|cntr|combo|user>
+	 * timer_idx <val>
+	 * cnt_idx <val>
+	 * adaptive <0|1>
+	 * rx_bytes <val>
+	 * rx_pkts <val>
+	 * rx_drop <0|1>
 	 * bufsz <val>
 	 * mode <mm|st>
 	 * dir <h2c|c2h>
@@ -311,6 +399,72 @@ static int read_qparm(int argc, char *argv[], int i, struct xcmd_q_parm *qparm,
 			f_arg_set |= 1 << QPARM_CDEV;
 			i++;
 
+		} else if (!strcmp(argv[i], "inline")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 != 0 && v1 != 1) {
+				warnx("unknown q inline %s, exp  <0|1>.\n",
+					argv[i]);
+				return -EINVAL;
+			}
+
+			if (v1)
+				qparm->flags |= XNL_F_INLINE_SUBMIT;
+
+			f_arg_set |= 1 << QPARM_INLINE;
+			i++;
+
+		} else if (!strcmp(argv[i], "bypass")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 != 0 && v1 != 1) {
+				warnx("unknown q bypass %s, exp  <0|1>.\n",
+					argv[i]);
+				return -EINVAL;
+			}
+
+			if (v1)
+				qparm->flags |= XNL_F_DESC_BYPASS;
+
+			f_arg_set |= 1 << QPARM_BYPASS;
+			i++;
+
+		} else if (!strcmp(argv[i], "pfetch")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 != 0 && v1 != 1) {
+				warnx("unknown q pfetch %s, exp  <0|1>.\n",
+					argv[i]);
+				return -EINVAL;
+			}
+
+			qparm->pfetch_en = v1;
+			f_arg_set |= 1 << QPARM_PFETCH;
+			i++;
+
+		} else if (!strcmp(argv[i], "pfetch_byp")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 != 0 && v1 != 1) {
+				warnx("unknown q pfetch_byp %s, exp  <0|1>.\n",
+					argv[i]);
+				return -EINVAL;
+			}
+
+			if (v1)
+				qparm->flags |= XNL_F_PFETCH_BYPASS;
+
+			f_arg_set |= 1 << QPARM_PFETCH_BYPASS;
+			i++;
+
 		} else if (!strcmp(argv[i], "bufsz")) {
 			rv = next_arg_read_int(argc, argv, &i, &v1);
 			if (rv < 0)
@@ -330,6 +484,156 @@ static int read_qparm(int argc, char *argv[], int i, struct xcmd_q_parm *qparm,
 			f_arg_set |= 1 << QPARM_RNGSZ;
 			i++;
 
+		} else if (!strcmp(argv[i], "wrb_ringsz")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->wrb_ringsz = v1;
+			f_arg_set |= 1 << QPARM_RNGSZ_WRB;
+			i++;
+
+		} else if (!strcmp(argv[i], "db_batch")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->pidx_db_batch = v1;
+			f_arg_set |= 1 << QPARM_PIDX_DB_BATCH;
+			i++;
+
+		} else if (!strcmp(argv[i], "desc_len")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->desc_len = v1;
+			f_arg_set |= 1 << QPARM_DESC_LEN;
+			i++;
+
+		} else if (!strcmp(argv[i], "wb_budget")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 > 0xFFFF) {
+				warnx("q wb_budget %u too big, max 65535.\n",
+					v1);
+				return -EINVAL;
+			}
+
+			qparm->wb_budget = v1;
+			f_arg_set |= 1 << QPARM_WB_BUDGET;
+			i++;
+
+		} else if (!strcmp(argv[i], "busy_poll")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->busy_poll = v1;
+			f_arg_set |= 1 << QPARM_BUSY_POLL;
+			i++;
+
+		} else if (!strcmp(argv[i], "trig_mode")) {
+			int j;
+
+			get_next_arg(argc, argv, (&i));
+
+			for (j = 0; j < sizeof(trig_mode_str) /
+					sizeof(trig_mode_str[0]); j++)
+				if (!strcmp(argv[i], trig_mode_str[j]))
+					break;
+			if (j == sizeof(trig_mode_str) /
+					sizeof(trig_mode_str[0])) {
+				warnx("unknown q trig_mode %s.\n", argv[i]);
+				return -EINVAL;
+			}
+
+			qparm->trig_mode = j + 1;
+			f_arg_set |= 1 << QPARM_TRIG_MODE;
+			i++;
+
+		} else if (!strcmp(argv[i], "timer_idx")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 > 15) {
+				warnx("q timer_idx %u, exp <0~15>.\n", v1);
+				return -EINVAL;
+			}
+
+			qparm->timer_idx = v1;
+			f_arg_set |= 1 << QPARM_TIMER_IDX;
+			i++;
+
+		} else if (!strcmp(argv[i], "cnt_idx")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 > 15) {
+				warnx("q cnt_idx %u, exp <0~15>.\n", v1);
+				return -EINVAL;
+			}
+
+			qparm->cnt_idx = v1;
+			f_arg_set |= 1 << QPARM_CNT_IDX;
+			i++;
+
+		} else if (!strcmp(argv[i], "adaptive")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 != 0 && v1 != 1) {
+				warnx("unknown q adaptive %s, exp  <0|1>.\n",
+					argv[i]);
+				return -EINVAL;
+			}
+
+			if (v1)
+				qparm->flags |= XNL_F_ADAPTIVE_COAL;
+
+			f_arg_set |= 1 << QPARM_ADAPTIVE;
+			i++;
+
+		} else if (!strcmp(argv[i], "rx_bytes")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->rx_max_bytes = v1;
+			f_arg_set |= 1 << QPARM_RX_BYTES;
+			i++;
+
+		} else if (!strcmp(argv[i], "rx_pkts")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			qparm->rx_max_pkts = v1;
+			f_arg_set |= 1 << QPARM_RX_PKTS;
+			i++;
+
+		} else if (!strcmp(argv[i], "rx_drop")) {
+			rv = next_arg_read_int(argc, argv, &i, &v1);
+			if (rv < 0)
+				return rv;
+
+			if (v1 != 0 && v1 != 1) {
+				warnx("unknown q rx_drop %s, exp  <0|1>.\n",
+					argv[i]);
+				return -EINVAL;
+			}
+
+			if (v1)
+				qparm->flags |= XNL_F_RX_DROP_OLDEST;
+
+			f_arg_set |= 1 << QPARM_RX_DROP;
+			i++;
+
 		} else if (!strcmp(argv[i], "desc")) {
 			get_next_arg(argc, argv, &i);
 			rv = read_range(argc, argv, i, &qparm->range_start,
@@ -412,6 +716,13 @@ static int parse_q_cmd(int argc, char *argv[], int i, struct xcmd_info *xcmd)
 	/*
 	 * q list
 	 * q add idx <N> mode <mm|st> [dir <h2c|c2h>] [cdev <0|1>] [wrbsz <0|1|2|3>]
+	 *	 [ringsz <0~15>] [wrb_ringsz <0~15>] [db_batch <N>] [desc_len <N>]
+	 *	 [inline <0|1>] [bypass <0|1>]
+	 *	 [pfetch <0|1>] [pfetch_byp <0|1>] [bufsz <0~15>]
+	 *	 [wb_budget <N>] [busy_poll <us>]
+	 *	 [trig_mode <any|timer|cntr|combo|user>] [timer_idx <0~15>]
+	 *	 [cnt_idx <0~15>] [adaptive <0|1>]
+	 *	 [rx_bytes <N>] [rx_pkts <N>] [rx_drop <0|1>]
 	 * q start idx <N> dir <h2c|c2h>
 	 * q stop idx <N> dir <h2c|c2h>
 	 * q del idx <N> dir <h2c|c2h>
@@ -262,6 +262,7 @@ static int recv_nl_msg(struct xnl_hdr *hdr, struct xcmd_info *xcmd)
 	case XNL_CMD_DEV_INFO:
 		xcmd->config_bar = xcmd->attrs[XNL_ATTR_DEV_CFG_BAR];
 		xcmd->user_bar = xcmd->attrs[XNL_ATTR_DEV_USR_BAR];
+		xcmd->bypass_bar = xcmd->attrs[XNL_ATTR_DEV_BYP_BAR];
 		xcmd->qmax = xcmd->attrs[XNL_ATTR_DEV_QSET_MAX];
 
 		printf("qdma%s%d:\t%02x:%02x.%02x\t",
@@ -269,8 +270,10 @@ static int recv_nl_msg(struct xnl_hdr *hdr, struct xcmd_info *xcmd)
 			xcmd->attrs[XNL_ATTR_PCI_BUS],
 			xcmd->attrs[XNL_ATTR_PCI_DEV],
 			xcmd->attrs[XNL_ATTR_PCI_FUNC]);
-		printf("config bar: %d, user bar: %d, max #. QP: %d\n",
-			xcmd->config_bar, xcmd->user_bar, xcmd->qmax);
+		printf("config bar: %d, user bar: %d, bypass bar: %d, "
+			"max #. QP: %d\n",
+			xcmd->config_bar, xcmd->user_bar,
+			xcmd->bypass_bar, xcmd->qmax);
 		break;
 	case XNL_CMD_Q_LIST:
 		break;
@@ -333,7 +336,37 @@ static int xnl_send_cmd(struct xnl_cb *cb, struct xcmd_info *xcmd)
 		xnl_msg_add_int_attr(hdr, XNL_ATTR_QIDX, xcmd->u.qparm.idx);
 		xnl_msg_add_int_attr(hdr, XNL_ATTR_QFLAG, xcmd->u.qparm.flags);
 		xnl_msg_add_int_attr(hdr, XNL_ATTR_QRNGSZ, xcmd->u.qparm.ringsz);
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_QRNGSZ_WRB,
+					xcmd->u.qparm.wrb_ringsz);
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_PIDX_DB_BATCH,
+					xcmd->u.qparm.pidx_db_batch);
+		xnl_msg_add_int_attr(hdr, XNL_ATTR_ST_H2C_DESC_LEN,
+					xcmd->u.qparm.desc_len);
 		xnl_msg_add_int_attr(hdr, XNL_ATTR_QBUFSZ, xcmd->u.qparm.bufsz);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_PFETCH)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_PFETCH_EN,
+					xcmd->u.qparm.pfetch_en);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_WB_BUDGET)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_WB_BUDGET,
+					xcmd->u.qparm.wb_budget);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_BUSY_POLL)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_BUSY_POLL,
+					xcmd->u.qparm.busy_poll);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_TRIG_MODE)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_TRIG_MODE,
+					xcmd->u.qparm.trig_mode);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_TIMER_IDX)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_TIMER_IDX,
+					xcmd->u.qparm.timer_idx);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_CNT_IDX)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_CNT_IDX,
+					xcmd->u.qparm.cnt_idx);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_RX_BYTES)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_RX_MAX_BYTES,
+					xcmd->u.qparm.rx_max_bytes);
+		if ((xcmd->u.qparm.sflags & (1 << QPARM_RX_PKTS)))
+			xnl_msg_add_int_attr(hdr, XNL_ATTR_RX_MAX_PKTS,
+					xcmd->u.qparm.rx_max_pkts);
 		if ((xcmd->u.qparm.sflags & (1 << QPARM_WRBSZ)))
 		        xnl_msg_add_int_attr(hdr,
 		                             XNL_ATTR_WRB_DESC_SIZE,
@@ -49,6 +49,17 @@ struct xcmd_q_parm {
 	unsigned int sflags;
 	uint32_t flags;
 	uint32_t ringsz;
+	uint32_t wrb_ringsz;
+	uint32_t pidx_db_batch;
+	uint32_t desc_len;
+	uint32_t pfetch_en;
+	uint32_t wb_budget;
+	uint32_t busy_poll;
+	uint32_t trig_mode;
+	uint32_t timer_idx;
+	uint32_t cnt_idx;
+	uint32_t rx_max_bytes;
+	uint32_t rx_max_pkts;
 	uint32_t bufsz;
 	uint32_t idx;
 	uint32_t range_start;
@@ -62,6 +73,7 @@ struct xcmd_info {
 	unsigned char if_idx;
 	unsigned char config_bar;
 	unsigned char user_bar;
+	char bypass_bar;		/* -1 if none */
 	unsigned short qmax;
 	char ifname[8];
 	union {